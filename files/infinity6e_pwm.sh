@@ -48,7 +48,10 @@ Commands:
   us <N>              Set pulse width in microseconds (preferred)
   pct <N>             Set duty percent (legacy fallback)
   sweep               Sweep MIN_US -> MAX_US -> CENTER_US using duty_us
-  info                Print current config + readback
+                      (waybeam-pwm pattern when installed)
+  info                Print current config + readback (no setup; pwmctl info
+                      does the same without forks)
+  bench [N]           Time N duty_us writes (default 10000) between MIN_US and MAX_US
 
 Options:
   --hz N              PWM frequency in Hz (default: $HZ)
@@ -118,7 +121,16 @@ pct_to_us() {
   echo $(( (pct * 10000 + HZ/2) / HZ ))
 }
 
+# Enabled at the requested frequency already (shell builtins only, no fork)
+pwm_running() {
+  [ -r "$P/enable" ] || return 1
+  read -r en < "$P/enable" && read -r hz < "$P/period" && [ "$en" = 1 ] && [ "$hz" = "$HZ" ]
+}
+
 ensure_pwm() {
+  # Re-muxing and toggling enable on a running channel glitches the output
+  pwm_running && return 0
+
   devmem "$MUX_REG" 16 "$MUX_VAL" >/dev/null
   [ -d "$P" ] || echo "$CH" > "$PWMCHIP/export"
 
@@ -187,17 +199,48 @@ print_info() {
 }
 
 sleep_ms() {
-  # BusyBox usually has usleep, fallback to sleep
+  # BusyBox usually has usleep, then fractional sleep (coreutils, BusyBox
+  # FEATURE_FANCY_SLEEP); whole seconds, rounded up, only as a last resort
   ms="$1"
   if command -v usleep >/dev/null 2>&1; then
     usleep $((ms * 1000))
-  else
-    # fallback (coarser)
-    sleep 1
+  elif ! sleep "$((ms / 1000)).$(printf '%03d' $((ms % 1000)))" 2>/dev/null; then
+    sleep $(( (ms + 999) / 1000 ))
   fi
 }
 
+# duty_us write cost through one open fd, as a control loop would do it.
+# Resolution is /proc/uptime (10ms), so use enough writes.
+bench_us() {
+  n="${1:-10000}"
+  [ -e "$DUTY_US_NODE" ] || { echo "bench requires duty_us"; exit 1; }
+
+  exec 3>"$DUTY_US_NODE"
+  t0="$(cut -d' ' -f1 /proc/uptime | tr -d .)"
+  i=0
+  while [ "$i" -lt "$n" ]; do
+    if [ $((i & 1)) -eq 0 ]; then echo "$MIN_US" >&3; else echo "$MAX_US" >&3; fi
+    i=$((i + 1))
+  done
+  t1="$(cut -d' ' -f1 /proc/uptime | tr -d .)"
+  exec 3>&-
+
+  set_us "$CENTER_US"
+  cs=$((t1 - t0))
+  [ "$cs" -gt 0 ] || cs=1
+  echo "bench: $n duty_us writes in $((cs * 10)) ms, $((cs * 10000 / n)) us/write (shell loop included)"
+}
+
 sweep_us() {
+  # waybeam-pwm pattern keeps one duty_us fd and schedules on absolute
+  # deadlines, so step timing does not drift with fork/exec per step
+  if [ -e "$DUTY_US_NODE" ] && command -v waybeam-pwm >/dev/null 2>&1; then
+    echo "Sweeping $PWM_NAME with waybeam-pwm pattern: ${MIN_US}us -> ${MAX_US}us -> ${CENTER_US}us"
+    waybeam-pwm pattern --no-mux --hz "$HZ" --min-us "$MIN_US" --center-us "$CENTER_US" --max-us "$MAX_US" \
+      "--pwm$CH-pattern" "step:$MIN_US-$MAX_US:$STEP_US:$STEP_DELAY_MS"
+    return
+  fi
+
   echo "Sweeping $PWM_NAME using duty_us-compatible path: ${MIN_US}us -> ${MAX_US}us -> ${CENTER_US}us"
   v="$MIN_US"
   while [ "$v" -le "$MAX_US" ]; do
@@ -221,7 +264,8 @@ for n in "$HZ" "$MIN_US" "$CENTER_US" "$MAX_US" "$STEP_US" "$STEP_DELAY_MS"; do
   is_uint "$n" || { echo "Numeric option expected, got '$n'"; exit 1; }
 done
 
-ensure_pwm
+# info only reads; everything else needs a running channel
+[ "$CMD" = info ] || ensure_pwm
 
 case "$CMD" in
   info)
@@ -255,6 +299,12 @@ case "$CMD" in
     sweep_us
     print_info
     ;;
+  bench)
+    if [ -n "$ARG" ]; then
+      is_uint "$ARG" || { echo "bench requires an integer write count"; exit 1; }
+    fi
+    bench_us "$ARG"
+    ;;
   *)
     usage
     ;;
@@ -4,7 +4,64 @@
 // Redistribution or commercial use requires prior written approval from Joakim Snökvist.
 // See LICENSE.md for full terms.
 
+#define _GNU_SOURCE
+
+// Compile-time feature selection (see Config.in / Makefile WITH_* switches).
+// Disabled features are compiled out entirely. Every switch below except
+// USDT defaults to 1; a minimal build sets all of them to 0 (`make help` and
+// the README list the full WITH_*=0 line).
+#ifndef WAYBEAM_WITH_SSE
+#define WAYBEAM_WITH_SSE 1      // SSE telemetry server
+#endif
+#ifndef WAYBEAM_WITH_LOG
+#define WAYBEAM_WITH_LOG 1      // -v/-vv/-vvv logging tiers and async log ring
+#endif
+#ifndef WAYBEAM_WITH_MUX
+#define WAYBEAM_WITH_MUX 1      // SigmaStar pin mux writes via /dev/mem
+#endif
+#ifndef WAYBEAM_WITH_UART
+#define WAYBEAM_WITH_UART 1     // --uart serial receiver input
+#endif
+#ifndef WAYBEAM_WITH_BPF
+#define WAYBEAM_WITH_BPF 1      // --udp-filter/--allow-src kernel socket filter
+#endif
+#ifndef WAYBEAM_WITH_TRACE
+#define WAYBEAM_WITH_TRACE 1    // --trace-marker ftrace lines at pipeline stages
+#endif
+#ifndef WAYBEAM_WITH_CTL
+#define WAYBEAM_WITH_CTL 1      // --ctl Unix control socket
+#endif
+#ifndef WAYBEAM_WITH_INJECT
+#define WAYBEAM_WITH_INJECT 1   // --inject local override/offset datagram input
+#endif
+#ifndef WAYBEAM_WITH_PATTERN
+#define WAYBEAM_WITH_PATTERN 1  // "pattern" sweep/step/sine/square generator mode
+#endif
+#ifndef WAYBEAM_WITH_PWMCTL
+#define WAYBEAM_WITH_PWMCTL 1   // "pwmctl" get/set/center/info subcommands
+#endif
+#ifndef WAYBEAM_WITH_ECHO
+#define WAYBEAM_WITH_ECHO 1     // --echo latency probe replies over UDP
+#endif
+#ifndef WAYBEAM_WITH_MAVLINK
+#define WAYBEAM_WITH_MAVLINK 1  // --proto mavlink RC_CHANNELS(_OVERRIDE) input
+#endif
+#ifndef WAYBEAM_WITH_SBUS
+#define WAYBEAM_WITH_SBUS 1     // --proto sbus / ibus serial receiver input
+#endif
+#ifndef WAYBEAM_WITH_HTTP
+#define WAYBEAM_WITH_HTTP 1     // POST /outputs on the SSE listener
+#endif
+#if !WAYBEAM_WITH_SSE
+#undef WAYBEAM_WITH_HTTP
+#define WAYBEAM_WITH_HTTP 0     // needs the SSE listener
+#endif
+#ifndef WAYBEAM_WITH_USDT
+#define WAYBEAM_WITH_USDT 0     // sys/sdt.h USDT probes (needs systemtap-sdt headers)
+#endif
+
 #include <arpa/inet.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -22,10 +79,64 @@
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#if WAYBEAM_WITH_BPF
+#include <linux/filter.h>
+#endif
+#if WAYBEAM_WITH_TRACE
+#include <stdarg.h>
+#endif
+#if WAYBEAM_WITH_USDT
+#include <sys/sdt.h>
+#endif
+#if WAYBEAM_WITH_CTL || WAYBEAM_WITH_INJECT
+#include <sys/un.h>
+#endif
+#if WAYBEAM_WITH_HTTP
+#include <strings.h>
+#endif
+#if WAYBEAM_WITH_UART
+#include <sys/ioctl.h>
+#include <asm/termbits.h>       // termios2/BOTHER for 420000 baud; clashes with <termios.h>
+#include <linux/serial.h>       // serial_icounter_struct
+#endif
+#if WAYBEAM_WITH_MUX
+#include <sys/mman.h>
+#endif
+#if WAYBEAM_WITH_PATTERN
+#include <math.h>
+#endif
+#if WAYBEAM_WITH_LOG
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
 
-#define PWMCHIP "/sys/class/pwm/pwmchip0"
+#ifndef PWM_CLASS
+#define PWM_CLASS "/sys/class/pwm"
+#endif
+#ifndef DEVMEM
+#define DEVMEM "/dev/mem"
+#endif
 #define MAX_CRSF_FRAME 64
 #define RXBUF_SIZE 4096
+#define UART_DEFAULT_BAUD 420000  // CRSF receiver default
+#define UART_NOSYNC_BYTES 2048  // bytes without one valid frame before the format warning
+#define PEER_RELEARN_DEFAULT_MS 2000
+#define PREDICT_DEFAULT_HORIZON_MS 40
+#define PREDICT_DEFAULT_MAX_US 150
+#define LINKQ_WINDOW 32         // intervals behind p50/p95/loss, refreshed once per window
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40          // older libc headers
+#endif
+#define MAX_ALLOW_SRC 8
+#define MAX_OUTPUTS 32          // pwm0/pwm1 plus --out, across all pwmchips
+#define MAX_PWMCHIPS 8
+#define UDP_FILTER_MAX_PAYLOAD 1024 // a handful of batched frames, never a full MTU
+
+// Async log ring (single producer: control loop, single consumer: drain thread)
+#define LOG_RING_SIZE 512       // power of two
+#define LOG_ARGS 8
+#define LOG_DRAIN_INTERVAL_MS 10
 
 // SSE server defaults
 #define SSE_DEFAULT_BIND "127.0.0.1"
@@ -36,23 +147,147 @@
 #define SSE_REQUEST_BUF 1024
 #define SSE_RESPONSE_BUF 512
 
+// POST /outputs
+#define HTTP_MAX_CLIENTS 2      // keep-alive connections, besides the SSE stream
+#define HTTP_MAX_BODY 256       // larger bodies are refused with 413
+#define HTTP_DEFAULT_PRIO 100
+#define HTTP_DEFAULT_TTL_MS 500
+
+// Control socket
+#define CTL_MAX_CLIENTS 4
+#define CTL_MSG_MAX 256         // larger requests are rejected with -EMSGSIZE
+
+// Local injection
+#define INJECT_PRIO_CTL 255     // --ctl overrides; injectors use 0..254
+#define INJECT_BATCH 8          // datagrams drained per loop pass
+
 // CRSF (TBS spec)
 #define CRSF_ADDR_FLIGHT_CONTROLLER 0xC8
 #define CRSF_TYPE_RC_CHANNELS_PACKED 0x16
+#define CRSF_ADDR_RADIO_TRANSMITTER 0xEA
+#define CRSF_TYPE_LATENCY_PROBE 0x7E     // extended, not used by RC links; see --echo
+
+#if WAYBEAM_WITH_LOG
+#define VERBOSE(cfg) ((cfg)->verbose)
+#else
+// Constant-folds every verbose branch out of the control path.
+#define VERBOSE(cfg) ((void)(cfg), 0)
+#endif
 
 static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_relearn = 0; // SIGHUP: drop the locked UDP peer
+
+// ---------------------------------------------------------------------------
+// Pipeline probes: udp_rx, frame_valid, rc_decoded, output_commit,
+// failsafe_enter/failsafe_exit, sse_emit. USDT probes are a nop until perf or
+// bpftrace attaches; trace_marker lines (--trace-marker) land in the ftrace
+// buffer next to the kernel pwm:* events. Compiled out, PROBE() costs nothing.
+// ---------------------------------------------------------------------------
+
+#if WAYBEAM_WITH_USDT
+#define PROBE_USDT(name, ...) STAP_PROBEV(waybeam, name, __VA_ARGS__)
+#else
+#define PROBE_USDT(name, ...) do { } while (0)
+#endif
+
+#if WAYBEAM_WITH_TRACE
+static int g_trace_fd = -1;
+
+__attribute__((format(printf, 1, 2)))
+static void trace_marker(const char *fmt, ...) {
+    char buf[160];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n <= 0) return;
+    if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    ssize_t w = write(g_trace_fd, buf, (size_t)n);
+    (void)w; // best effort, the trace buffer may be off
+}
+
+static int trace_marker_open(void) {
+    static const char *const paths[] = {
+        "/sys/kernel/tracing/trace_marker",
+        "/sys/kernel/debug/tracing/trace_marker",
+    };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        g_trace_fd = open(paths[i], O_WRONLY | O_CLOEXEC);
+        if (g_trace_fd >= 0) return 0;
+    }
+    return -1;
+}
+
+#define PROBE_MARK(...) do { if (g_trace_fd >= 0) trace_marker(__VA_ARGS__); } while (0)
+#else
+#define PROBE_MARK(...) do { } while (0)
+#endif
+
+#define PROBE(name, fmt, ...) do { \
+        PROBE_USDT(name, __VA_ARGS__); \
+        PROBE_MARK("waybeam " #name ": " fmt "\n", __VA_ARGS__); \
+    } while (0)
+
+enum { PREDICT_OFF, PREDICT_LINEAR, PREDICT_AB };
+enum { PROTO_CRSF, PROTO_MAVLINK, PROTO_SBUS, PROTO_IBUS };
+enum { RX_FAILSAFE = 1, RX_FRAME_LOST = 2 };
+enum { FS_STAGE_HOLD, FS_STAGE_RAMP, FS_STAGE_FINAL };
+enum { PAT_NONE, PAT_SWEEP, PAT_STEP, PAT_SINE, PAT_SQUARE };
+
+// One output's test pattern, see parse_pattern_spec()
+typedef struct {
+    int shape;             // PAT_*
+    int lo_us;
+    int hi_us;
+    int period_ms;         // one cycle; PAT_STEP: hold time per step
+    int step_us;           // PAT_STEP only
+} pattern_t;
 
 typedef struct {
-    int port;              // UDP listen port
-    int pwm0_ch;           // CRSF channel index 1..16, or 0 disabled
-    int pwm1_ch;           // CRSF channel index 1..16, or 0 disabled
+    int port;              // UDP listen port, 0 = no UDP input (needs --uart)
+    char uart_dev[64];     // serial receiver, empty = disabled
+    int uart_baud;
+    bool udp_filter;       // kernel BPF filter: only plausible CRSF datagrams wake the loop
+    int allow_src_count;   // 0 = any source
+    struct {
+        uint32_t addr;     // host order, 0 = any address
+        uint16_t port;     // 0 = any port
+    } allow_src[MAX_ALLOW_SRC];
+    bool peer_lock;        // connect() the UDP socket to the first valid RC source
+    int peer_relearn_ms;   // drop the peer after this much silence, 0 = SIGHUP only
+    int rcvbuf;            // SO_RCVBUF bytes, 0 = kernel default
+    int max_age_ms;        // discard datagrams queued longer than this, 0 = off
+    bool echo;             // answer latency probe frames to their sender
+    int proto;             // PROTO_*: what UDP and UART carry, see rc_protos[]
+    // Outputs 0 and 1 are pwmchip0 pwm0/pwm1 (--pwm0-ch/--pwm1-ch), then --out
+    int out_count;
+    int out_ch[MAX_OUTPUTS]; // CRSF channel index 1..16, or 0 disabled
+    struct {
+        int chip;          // pwmchipN, -1 = resolve driver[] at startup
+        int hw;            // channel on that chip
+        char driver[24];   // driver name from --out DRIVER:CH
+    } out_addr[MAX_OUTPUTS];
     int hz;                // PWM frequency
     int min_us;            // clamp min
     int max_us;            // clamp max
     int center_us;         // failsafe center
     int hold_ms;           // hold last command before centering
     int center_timeout_ms; // center after no packets
+    bool adaptive_timeouts; // derive hold/center from the observed frame interval
+    int adaptive_hold_x;   // hold = N x p95 interval
+    int adaptive_center_x; // center = N x p95 interval
+    int adaptive_min_ms;   // bounds for both derived thresholds
+    int adaptive_max_ms;
+    int predict;           // PREDICT_OFF, PREDICT_LINEAR, PREDICT_AB
+    int predict_horizon_ms; // extrapolate this long into a gap, then decay to hold
+    int predict_max_us;    // cap on the extrapolated offset from the last real value
+    int deadband_us[MAX_OUTPUTS];   // per-output: ignore changes within +-N us of last write
+    int hysteresis_us[MAX_OUTPUTS]; // per-output: extra margin required to reverse direction
+    int failsafe_us[MAX_OUTPUTS];   // per-output final failsafe value, 0 = center_us
+    int failsafe_ramp_ms[MAX_OUTPUTS]; // per-output ramp to failsafe_us, 0 = jump
+    bool failsafe_hold[MAX_OUTPUTS]; // per-output: keep the last value on failsafe
     int verbose;
+    bool kernel_failsafe;  // arm driver duty_us heartbeat instead of polling timeouts
     bool no_mux;
     bool mux_init_once;
     uint16_t mux_init_val;
@@ -66,6 +301,22 @@ typedef struct {
     int sse_port;
     char sse_path[64];
     int sse_rate_hz;
+    bool http_outputs;     // POST /outputs on the SSE listener
+    int http_prio;         // injection priority of its overrides, 0..254
+    int http_ttl_ms;       // override lifetime, 0 = until released
+    bool http_link;        // a POST also counts as an RC update
+    char http_origin[128]; // Access-Control-Allow-Origin on /outputs, empty = none
+    // Control socket
+    char ctl_path[108];    // sun_path, empty = disabled
+    // Local injection
+    char inject_path[108]; // sun_path, empty = disabled
+    // Init script integration
+    char pidfile[108];     // written once ready, removed on a clean exit; empty = none
+    int notify_fd;         // gets "READY=1\n" and is closed once ready, -1 = none
+    // Pattern mode
+    pattern_t pattern[MAX_OUTPUTS]; // per output, PAT_NONE = output unused
+    int pattern_cycles;    // 0 = until stopped
+    int pattern_rate_hz;   // updates per second, 0 = one per PWM period
 } cfg_t;
 
 typedef struct {
@@ -79,20 +330,47 @@ typedef struct {
     int accepted;
 } sse_pending_client_t;
 
+enum { PWM_BACKEND_DUTY_US, PWM_BACKEND_NS };
+
+// /sys/class/pwm/pwmchipN as found at startup
 typedef struct {
-    int ch;                 // pwm index 0 or 1
+    int num;
+    int npwm;
+    char driver[24];        // "?" without a device/driver link
+} pwm_chip_t;
+
+typedef struct {
+    int ch;                 // output index, 0 and 1 = pwm0/pwm1
+    int chip;               // pwmchipN
+    int hw;                 // channel on the chip
+    int backend;            // PWM_BACKEND_*: patched duty_us, or mainline duty_cycle in ns
     char path[128];
-    char duty_us_path[160];
-    char duty_pct_path[160];
+    char duty_path[160];    // duty_us, or duty_cycle (ns) on the mainline backend
     char period_path[160];
     char enable_path[160];
     char polarity_path[160];
-    int fd_duty_us;
+    char state_path[160];
+    int fd_duty;
     int fd_period;
     int fd_enable;
+    int fd_failsafe_active; // pollable driver flag, -1 without kernel failsafe
+    int heartbeat_ms;       // driver heartbeat window, 0 = disarmed
+    uint64_t last_write_ms;
     int last_us;
+    int last_dir;           // direction of last written change: -1, 0, +1
+    int deadband_us;
+    int hysteresis_us;
+    int failsafe_us;        // final failsafe value, also written at startup
+    int failsafe_ramp_ms;   // ramp to failsafe_us after the hold stage, 0 = jump
+    bool failsafe_hold;     // gimbal-style: keep the last value
     bool available;
     bool enabled;
+    // Metrics
+    size_t writes;
+    size_t write_errors;
+    size_t suppressed;      // dropped by deadband/hysteresis
+    size_t unchanged;       // identical to last written value
+    size_t predicted;       // extrapolated during a frame gap
 } pwm_out_t;
 
 typedef struct {
@@ -100,29 +378,457 @@ typedef struct {
     size_t len;
 } stream_buf_t;
 
+typedef struct {
+    size_t datagrams;
+    size_t stale;           // discarded by --max-age-ms before parsing
+    uint32_t kernel_drops;  // SO_RXQ_OVFL: receive queue overflows since open
+} udp_stats_t;
+
 static uint64_t mono_ms(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
 }
 
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)(ts.tv_nsec / 1000ULL);
+}
+
+#if WAYBEAM_WITH_LOG
+// ---------------------------------------------------------------------------
+// Async log ring
+//
+// The control loop records binary events (code + args + timestamp) and never
+// touches stderr; a SCHED_IDLE thread formats and writes them. A full ring
+// drops the event and counts it instead of blocking the PWM path.
+// Before the drain thread starts and after it stops, events format inline.
+// ---------------------------------------------------------------------------
+
+typedef enum {
+    EV_UDP_RX = 1,          // bytes, ip(be), port, got_rc
+    EV_UDP_RX_STATS,        // bytes, ip(be), port, frames, crc_ok, rc, bad_addr, bad_crc
+    EV_UDP_RX_EMPTY,
+    EV_RECV_ERR,            // errno
+    EV_UART_RX,             // bytes, got_rc
+    EV_UART_RX_STATS,       // bytes, frames, crc_ok, rc, bad_addr, bad_crc
+    EV_UART_ERR,            // errno (0 = hangup)
+    EV_SOCK_ERR,            // revents
+    EV_UDP_OVFL,            // new kernel drops, total
+    EV_UDP_STALE,           // bytes, age ms
+    EV_PEER_LOCK,           // ip(be), port
+    EV_PEER_UNLOCK,         // ip(be), port, silence ms (0 = SIGHUP)
+    EV_PEER_FOREIGN,        // bytes, ip(be), port
+    EV_CRSF_RC,
+    EV_CRSF_RC_BAD_LEN,     // payload_len
+    EV_MAV_RC,              // msgid, sysid, channels set
+    EV_RX_FRAME,            // proto, RX_* flags
+    EV_MAP,                 // crsf ch, raw us, pwm, clamped us
+    EV_RC_SUMMARY,          // ch a, us a, ch b, us b
+    EV_PWM_WRITE,           // pwm, us
+    EV_PWM_WRITE_CLAMPED,   // pwm, us, requested
+    EV_PWM_WRITE_FAIL,      // pwm, us, errno
+    EV_PWM_UNCHANGED,       // pwm, us
+    EV_PWM_SUPPRESSED,      // pwm, us, last, deadband, hysteresis
+    EV_CENTER,              // center us
+    EV_FS_STAGE,            // pwm, stage (FS_STAGE_*), us, ramp ms
+    EV_LINK_RECOVERED,
+    EV_FAILSAFE,            // age ms
+    EV_KFAILSAFE,           // pwm, failsafe us
+    EV_PREDICT,             // pwm, us, last real us, gap ms
+    EV_LINKQ,               // p50 us, p95 us, jitter us, loss permille, hold ms, center ms
+    EV_SSE_CONNECTED,
+    EV_SSE_DISCONNECTED,
+    EV_SSE_TIMEOUT,
+    EV_HTTP_CONNECTED,      // slot
+    EV_HTTP_FULL,
+    EV_HTTP_CLOSED,         // slot
+    EV_HTTP_OUTPUTS,        // entries, applied, refused, status
+    EV_CTL_CONNECTED,       // slot
+    EV_CTL_FULL,
+    EV_CTL_CLOSED,          // slot
+    EV_CTL_REQ,             // op, arg a, arg b, errno (0 = ok)
+    EV_INJECT,              // entries, prio, applied, refused, invalid
+} log_code_t;
+
+typedef struct {
+    uint64_t ts_us;
+    uint32_t code;
+    uint32_t a[LOG_ARGS];
+} log_event_t;
+
+typedef struct {
+    log_event_t ev[LOG_RING_SIZE];
+    _Atomic uint32_t head;      // written by producer
+    _Atomic uint32_t tail;      // written by consumer
+    _Atomic uint32_t dropped;   // overflow count, reported by the drain
+    _Atomic bool running;
+    _Atomic bool stop;
+    pthread_t thread;
+} log_ring_t;
+
+static log_ring_t g_log;
+
+static void log_format(const log_event_t *e) {
+    const uint32_t *a = e->a;
+    char ip[INET_ADDRSTRLEN] = "?";
+    struct in_addr in;
+
+    fprintf(stderr, "[%5llu.%06llu] ",
+            (unsigned long long)(e->ts_us / 1000000ULL),
+            (unsigned long long)(e->ts_us % 1000000ULL));
+
+    switch ((log_code_t)e->code) {
+    case EV_UDP_RX:
+        in.s_addr = a[1];
+        (void)inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        fprintf(stderr, "UDP rx: %u bytes from %s:%u%s\n",
+                a[0], ip, a[2], a[3] ? " (RC update)" : " (no RC)");
+        break;
+    case EV_UDP_RX_STATS:
+        in.s_addr = a[1];
+        (void)inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        fprintf(stderr,
+                "UDP rx: %u bytes from %s:%u | frames=%u crc_ok=%u rc=%u bad_addr=%u bad_crc=%u\n",
+                a[0], ip, a[2], a[3], a[4], a[5], a[6], a[7]);
+        break;
+    case EV_UDP_RX_EMPTY:
+        fprintf(stderr, "recvfrom returned 0 bytes\n");
+        break;
+    case EV_RECV_ERR:
+        fprintf(stderr, "recv: %s\n", strerror((int)a[0]));
+        break;
+    case EV_UART_RX:
+        fprintf(stderr, "UART rx: %u bytes%s\n", a[0], a[1] ? " (RC update)" : " (no RC)");
+        break;
+    case EV_UART_RX_STATS:
+        fprintf(stderr, "UART rx: %u bytes | frames=%u crc_ok=%u rc=%u bad_addr=%u bad_crc=%u\n",
+                a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+    case EV_UART_ERR:
+        fprintf(stderr, "UART: %s, input disabled\n", a[0] ? strerror((int)a[0]) : "hangup");
+        break;
+    case EV_SOCK_ERR:
+        fprintf(stderr, "Socket error revents=0x%x, outputs to failsafe values\n", a[0]);
+        break;
+    case EV_UDP_OVFL:
+        fprintf(stderr, "UDP rx: receive queue overflow, %u datagram(s) dropped by the kernel (total %u)\n",
+                a[0], a[1]);
+        break;
+    case EV_UDP_STALE:
+        fprintf(stderr, "UDP rx: %u bytes discarded, queued for %ums\n", a[0], a[1]);
+        break;
+    case EV_PEER_LOCK:
+        in.s_addr = a[0];
+        (void)inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        fprintf(stderr, "UDP peer locked to %s:%u, other senders dropped\n", ip, a[1]);
+        break;
+    case EV_PEER_UNLOCK:
+        in.s_addr = a[0];
+        (void)inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        if (a[2]) {
+            fprintf(stderr, "UDP peer %s:%u silent for %ums, relearning\n", ip, a[1], a[2]);
+        } else {
+            fprintf(stderr, "UDP peer %s:%u released (SIGHUP), relearning\n", ip, a[1]);
+        }
+        break;
+    case EV_PEER_FOREIGN:
+        in.s_addr = a[1];
+        (void)inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        fprintf(stderr, "UDP rx: %u bytes from %s:%u dropped, queued before the peer lock\n", a[0], ip, a[2]);
+        break;
+    case EV_CRSF_RC:
+        fprintf(stderr, "CRSF RC frame parsed\n");
+        break;
+    case EV_CRSF_RC_BAD_LEN:
+        fprintf(stderr, "CRSF RC frame ignored: invalid payload_len=%u\n", a[0]);
+        break;
+    case EV_MAV_RC:
+        fprintf(stderr, "MAVLink %s from sysid %u: %u channels\n",
+                a[0] == 70 ? "RC_CHANNELS_OVERRIDE" : "RC_CHANNELS", a[1], a[2]);
+        break;
+    case EV_RX_FRAME:
+        fprintf(stderr, "%s frame parsed%s%s\n", a[0] == PROTO_SBUS ? "SBUS" : "IBUS",
+                (a[1] & RX_FRAME_LOST) ? ", frame lost" : "",
+                (a[1] & RX_FAILSAFE) ? ", receiver failsafe: ignored" : "");
+        break;
+    case EV_MAP:
+        fprintf(stderr, "Map: CH%u=%dus -> PWM%u=%dus\n", a[0], (int)a[1], a[2], (int)a[3]);
+        break;
+    case EV_RC_SUMMARY:
+        fprintf(stderr, "RC: ch%02u=%d ch%02u=%d\n", a[0], (int)a[1], a[2], (int)a[3]);
+        break;
+    case EV_PWM_WRITE:
+        fprintf(stderr, "PWM%u <- %dus\n", a[0], (int)a[1]);
+        break;
+    case EV_PWM_WRITE_CLAMPED:
+        fprintf(stderr, "PWM%u <- %dus (clamped from %dus)\n", a[0], (int)a[1], (int)a[2]);
+        break;
+    case EV_PWM_WRITE_FAIL:
+        fprintf(stderr, "PWM%u write failed for duty_us=%d: %s\n",
+                a[0], (int)a[1], strerror((int)a[2]));
+        break;
+    case EV_PWM_UNCHANGED:
+        fprintf(stderr, "PWM%u unchanged: duty_us=%d\n", a[0], (int)a[1]);
+        break;
+    case EV_PWM_SUPPRESSED:
+        fprintf(stderr, "PWM%u suppressed: duty_us=%d (last %d, deadband %d, hysteresis %d)\n",
+                a[0], (int)a[1], (int)a[2], (int)a[3], (int)a[4]);
+        break;
+    case EV_CENTER:
+        fprintf(stderr, "Outputs to failsafe values (center %dus)\n", (int)a[0]);
+        break;
+    case EV_FS_STAGE:
+        if (a[1] == FS_STAGE_HOLD) {
+            fprintf(stderr, "PWM%u failsafe: hold at %dus\n", a[0], (int)a[2]);
+        } else if (a[1] == FS_STAGE_RAMP) {
+            fprintf(stderr, "PWM%u failsafe: ramp to %dus over %ums\n", a[0], (int)a[2], a[3]);
+        } else {
+            fprintf(stderr, "PWM%u failsafe: final %dus\n", a[0], (int)a[2]);
+        }
+        break;
+    case EV_LINK_RECOVERED:
+        fprintf(stderr, "Link recovered: valid RC frame received\n");
+        break;
+    case EV_FAILSAFE:
+        fprintf(stderr, "FAILSAFE: no valid RC frame for %ums -> failsafe outputs\n", a[0]);
+        break;
+    case EV_KFAILSAFE:
+        fprintf(stderr, "FAILSAFE: kernel heartbeat expired on PWM%u -> %dus\n", a[0], (int)a[1]);
+        break;
+    case EV_PREDICT:
+        fprintf(stderr, "PWM%u predicted %dus (last frame %dus, gap %ums)\n",
+                a[0], (int)a[1], (int)a[2], a[3]);
+        break;
+    case EV_LINKQ:
+        fprintf(stderr, "Link: interval p50=%uus p95=%uus jitter=%uus loss=%u.%u%% -> hold %ums center %ums\n",
+                a[0], a[1], a[2], a[3] / 10, a[3] % 10, a[4], a[5]);
+        break;
+    case EV_SSE_CONNECTED:
+        fprintf(stderr, "SSE: client connected\n");
+        break;
+    case EV_SSE_DISCONNECTED:
+        fprintf(stderr, "SSE: client disconnected\n");
+        break;
+    case EV_SSE_TIMEOUT:
+        fprintf(stderr, "SSE: client handshake timed out\n");
+        break;
+    case EV_HTTP_CONNECTED:
+        fprintf(stderr, "HTTP: client %u connected\n", a[0]);
+        break;
+    case EV_HTTP_FULL:
+        fprintf(stderr, "HTTP: client rejected, %d already connected\n", HTTP_MAX_CLIENTS);
+        break;
+    case EV_HTTP_CLOSED:
+        fprintf(stderr, "HTTP: client %u closed\n", a[0]);
+        break;
+    case EV_HTTP_OUTPUTS:
+        fprintf(stderr, "HTTP: POST /outputs %u entries: applied=%u refused=%u -> %u\n",
+                a[0], a[1], a[2], a[3]);
+        break;
+    case EV_INJECT:
+        fprintf(stderr, "Inject: %u entries prio %u: applied=%u refused=%u invalid=%u\n",
+                a[0], a[1], a[2], a[3], a[4]);
+        break;
+    case EV_CTL_CONNECTED:
+        fprintf(stderr, "CTL: client %u connected\n", a[0]);
+        break;
+    case EV_CTL_FULL:
+        fprintf(stderr, "CTL: client rejected, %d already connected\n", CTL_MAX_CLIENTS);
+        break;
+    case EV_CTL_CLOSED:
+        fprintf(stderr, "CTL: client %u closed\n", a[0]);
+        break;
+    case EV_CTL_REQ:
+        if (a[3]) {
+            fprintf(stderr, "CTL: op %u (%d, %d) failed: %s\n", a[0], (int)a[1], (int)a[2], strerror((int)a[3]));
+        } else {
+            fprintf(stderr, "CTL: op %u (%d, %d)\n", a[0], (int)a[1], (int)a[2]);
+        }
+        break;
+    default:
+        fprintf(stderr, "log event %u\n", e->code);
+        break;
+    }
+}
+
+static void log_push(log_code_t code, const uint32_t args[LOG_ARGS]) {
+    log_event_t *e;
+    log_event_t inline_ev;
+
+    if (!atomic_load_explicit(&g_log.running, memory_order_relaxed)) {
+        e = &inline_ev;
+    } else {
+        uint32_t head = atomic_load_explicit(&g_log.head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(&g_log.tail, memory_order_acquire);
+        if (head - tail >= LOG_RING_SIZE) {
+            atomic_fetch_add_explicit(&g_log.dropped, 1, memory_order_relaxed);
+            return;
+        }
+        e = &g_log.ev[head & (LOG_RING_SIZE - 1)];
+    }
+
+    e->ts_us = mono_us();
+    e->code = (uint32_t)code;
+    memcpy(e->a, args, sizeof(e->a));
+
+    if (e == &inline_ev) {
+        log_format(e);
+        return;
+    }
+    atomic_store_explicit(&g_log.head,
+                          atomic_load_explicit(&g_log.head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Unused trailing args are zero-filled by the compound literal.
+#define LOGE(code, ...) log_push((code), (const uint32_t[LOG_ARGS]){ __VA_ARGS__ })
+
+static void log_drain(void) {
+    uint32_t tail = atomic_load_explicit(&g_log.tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&g_log.head, memory_order_acquire);
+    while (tail != head) {
+        log_format(&g_log.ev[tail & (LOG_RING_SIZE - 1)]);
+        tail++;
+        atomic_store_explicit(&g_log.tail, tail, memory_order_release);
+    }
+
+    uint32_t dropped = atomic_exchange_explicit(&g_log.dropped, 0, memory_order_relaxed);
+    if (dropped) {
+        fprintf(stderr, "LOG: ring overflow, %u events dropped\n", dropped);
+    }
+}
+
+static void *log_drain_thread(void *arg) {
+    (void)arg;
+#ifdef SCHED_IDLE
+    struct sched_param sp = { .sched_priority = 0 };
+    (void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+#endif
+    const struct timespec tick = { .tv_sec = 0, .tv_nsec = LOG_DRAIN_INTERVAL_MS * 1000000L };
+    while (!atomic_load_explicit(&g_log.stop, memory_order_relaxed)) {
+        log_drain();
+        nanosleep(&tick, NULL);
+    }
+    log_drain();
+    return NULL;
+}
+
+static void log_ring_start(void) {
+    atomic_store(&g_log.stop, false);
+    atomic_store(&g_log.running, true);
+    if (pthread_create(&g_log.thread, NULL, log_drain_thread, NULL) != 0) {
+        atomic_store(&g_log.running, false);
+        fprintf(stderr, "WARN: log drain thread failed to start; logging inline\n");
+    }
+}
+
+static void log_ring_stop(void) {
+    if (!atomic_load(&g_log.running)) return;
+    atomic_store(&g_log.stop, true);
+    pthread_join(g_log.thread, NULL);
+    atomic_store(&g_log.running, false);
+}
+
+#else
+#define LOGE(code, ...) ((void)0)
+static void log_ring_start(void) {}
+static void log_ring_stop(void) {}
+#endif
+
 static void on_sig(int sig) {
     (void)sig;
     g_stop = 1;
 }
 
+static void on_hup(int sig) {
+    (void)sig;
+    g_relearn = 1;
+}
+
 static void usage(const char *argv0) {
     fprintf(stderr,
         "Usage: %s [options]\n"
-        "  --port N              UDP port (default 9000)\n"
+        "  --port N              UDP port, 0 = no UDP input (default 9000)\n"
+#if WAYBEAM_WITH_UART
+        "  --uart DEV            Also read RC from a serial receiver (e.g. /dev/ttyS2)\n"
+        "  --uart-baud N         Serial baud rate (default: the --proto rate, 420000 for CRSF)\n"
+#endif
         "  --pwm0-ch N           Map CRSF channel N (1..16) to pwm0 (default 1)\n"
         "  --pwm1-ch N           Map CRSF channel N (1..16) to pwm1 (default 2)\n"
+        "  --out CHIP:N=CH       Also drive pwmN of another pwmchip from CRSF channel CH;\n"
+        "                        CHIP is a pwmchip number or driver name (repeatable)\n"
         "  --hz N                PWM frequency Hz (default 50)\n"
         "  --min-us N            Clamp min output us (default 1000)\n"
         "  --max-us N            Clamp max output us (default 2000)\n"
         "  --center-us N         Center/failsafe us (default 1500)\n"
         "  --hold-ms N           Hold last value after link loss (default 300)\n"
         "  --center-timeout-ms N Center outputs after no valid frame (default 500)\n"
+        "  --rcvbuf N            UDP receive buffer in bytes (default: kernel default)\n"
+        "  --max-age-ms N        Discard datagrams that sat in the queue longer than N ms\n"
+        "                        (RX timestamps, default 0 = off)\n"
+        "  --proto P             Input format on UDP and UART: crsf (default)"
+#if WAYBEAM_WITH_MAVLINK
+        ", mavlink"
+#endif
+#if WAYBEAM_WITH_SBUS
+        ", sbus, ibus"
+#endif
+        "\n"
+#if WAYBEAM_WITH_MAVLINK
+        "                        mavlink: v1/v2 RC_CHANNELS_OVERRIDE and RC_CHANNELS\n"
+#endif
+#if WAYBEAM_WITH_SBUS
+        "                        sbus: 100000 baud 8E2, inverted line needs an inverter\n"
+        "                        ibus: 115200 baud 8N1\n"
+#endif
+#if WAYBEAM_WITH_ECHO
+        "  --echo                Answer latency probe frames to their sender with the RX\n"
+        "                        and PWM write-done times\n"
+#endif
+        "  --peer-lock           connect() the UDP socket to the first valid RC source;\n"
+        "                        the kernel then drops every other sender\n"
+        "  --peer-relearn-ms N   Release the peer after N ms without RC, 0 = only on\n"
+        "                        SIGHUP (default 2000)\n"
+        "  --adaptive-timeouts   Derive hold/center from the measured RC frame interval\n"
+        "  --adaptive-hold-x N   hold = N x p95 interval (default 3)\n"
+        "  --adaptive-center-x N center = N x p95 interval (default 10)\n"
+        "  --adaptive-min-ms N   Lower bound for derived thresholds (default 20)\n"
+        "  --adaptive-max-ms N   Upper bound for derived thresholds (default 2000)\n"
+        "  --predict MODE        Extrapolate outputs through late frames: linear or ab\n"
+        "                        (alpha-beta); default off\n"
+        "  --predict-horizon-ms N Extrapolate for N ms, then decay back to hold (default 40)\n"
+        "  --predict-max-us N    Max extrapolated offset from the last frame (default 150)\n"
+        "  --pwm0-failsafe SPEC  pwm0 failsafe after center-timeout: center (default), hold,\n"
+        "                        US (jump) or US/MS (ramp over MS ms); also --pwm1-failsafe\n"
+        "  --failsafe OUT=SPEC   The same for any output: OUT is pwmN (pwmchip0) or CHIP:N\n"
+        "                        as given to an earlier --out\n"
+        "  --kernel-failsafe     Arm driver duty_us heartbeat (failsafe_us=final failsafe value,\n"
+        "                        heartbeat_ms=center-timeout); works even if this process dies\n"
+#if WAYBEAM_WITH_BPF
+        "  --udp-filter          Drop non-CRSF datagrams in the kernel (BPF socket filter)\n"
+        "  --allow-src A[:P]     Only accept UDP from address A (and port P); repeatable,\n"
+        "                        implies --udp-filter. :P alone allows any address\n"
+#endif
+#if WAYBEAM_WITH_TRACE
+        "  --trace-marker        Write pipeline probe lines to the ftrace trace_marker\n"
+#endif
+#if WAYBEAM_WITH_CTL
+        "  --ctl PATH            Unix control socket (SOCK_SEQPACKET, binary protocol)\n"
+#endif
+#if WAYBEAM_WITH_INJECT
+        "  --inject PATH         Unix datagram socket for local channel overrides and\n"
+        "                        additive offsets with priority and TTL\n"
+#endif
+        , argv0);
+    fprintf(stderr,
+        "  --deadband-us N       Ignore changes within +-N us of last write, all outputs (default 0);\n"
+        "                        OUT=N sets one output (OUT as for --failsafe)\n"
+        "  --hysteresis-us N     Extra us needed to reverse direction, all outputs (default 0);\n"
+        "                        OUT=N sets one output\n"
+        "  --pwm0-deadband-us N  Per-output deadband override (also --pwm1-deadband-us)\n"
+        "  --pwm0-hysteresis-us N Per-output hysteresis override (also --pwm1-hysteresis-us)\n"
         "  --no-mux              Do not write pin mux register (external setup)\n"
         "  --mux-reg ADDR        Mux register address (default 0x1f207994)\n"
         "  --mux-pwm0 VAL        Mux write value for pwm0 init (default 0x1102)\n"
@@ -132,10 +838,24 @@ static void usage(const char *argv0) {
         "  -v                    Verbose logs (packet + state)\n"
         "  -vv                   More detail (frame counters + output updates)\n"
         "  -vvv                  Very verbose (unchanged output skips)\n"
+        "  --pidfile PATH        Write the PID once ready, remove it after the centering exit\n"
+        "  --notify-fd N         Write \"READY=1\" to fd N and close it once outputs are\n"
+        "                        centered and inputs bound (EOF alone = startup failed)\n"
         "  --sse                 Enable SSE server for channel telemetry\n"
         "  --sse-bind HOST:PORT  SSE bind address (default 127.0.0.1:8070)\n"
         "  --sse-path PATH       SSE HTTP path (default /sse)\n"
         "  --sse-rate N          SSE emission rate in Hz, 1-100 (default 10)\n"
+#if WAYBEAM_WITH_HTTP
+        "  --http-outputs        Accept keep-alive POST /outputs (\"1=1600&2=1400\") on the\n"
+        "                        SSE listener as channel overrides; implies --sse\n"
+        "  --http-prio N         Override priority, 0-254 (default 100)\n"
+        "  --http-ttl-ms N       Override lifetime, 0 = until released (default 500)\n"
+        "  --http-link           A POST also counts as an RC frame (web UI as the only input)\n"
+        "  --http-origin ORIGIN  Web UI origin allowed to POST /outputs cross-origin\n"
+        "                        (e.g. http://192.168.1.20:8080; default none)\n"
+#endif
+        );
+    fprintf(stderr,
         "\n"
         "Examples:\n"
         "  %s --port 9000 --pwm0-ch 1 --pwm1-ch 2 -v\n"
@@ -144,7 +864,47 @@ static void usage(const char *argv0) {
         "  %s --mux-reg 0x1f207994 --mux-pwm0 0x1102 --mux-pwm1 0x1121\n"
         "  %s --mux-init-val 0x1122 --pwm0-ch 1 --pwm1-ch 2 -vv\n"
         "  %s --sse --sse-bind 0.0.0.0:8070 -v\n",
-        argv0, argv0, argv0, argv0, argv0, argv0, argv0);
+        argv0, argv0, argv0, argv0, argv0, argv0);
+#if WAYBEAM_WITH_PATTERN
+    fprintf(stderr,
+        "\n"
+        "Pattern mode: %s pattern [--out CHIP:N=0]... --pattern OUT=SPEC... [options]\n"
+        "  --pattern OUT=SPEC    Play SPEC on OUT, pwmN (pwmchip0) or CHIP:N as given to\n"
+        "                        --out (repeatable; --pwm0-pattern SPEC = --pattern pwm0=SPEC):\n"
+        "                        sweep:LO-HI:MS   triangle LO->HI->LO, MS per cycle\n"
+        "                        sine:LO-HI:MS    sine LO..HI, MS per cycle\n"
+        "                        square:LO-HI:MS  LO/HI halves, MS per cycle\n"
+        "                        step:LO-HI:US:MS staircase in US steps, MS per step\n"
+        "  --cycles N            Cycles per output, 0 = until stopped (default 1)\n"
+        "  --rate-hz N           Updates per second, 1-1000 (default: --hz, one per PWM period)\n"
+        "  --hz, --min-us, --max-us, --center-us, --failsafe, --kernel-failsafe, mux\n"
+        "  options and -v apply as above. Prints deadline and write timing at the end.\n"
+        "  %s pattern --pwm0-pattern sine:1000-2000:2000 --cycles 5 -v\n",
+        argv0, argv0);
+#endif
+#if WAYBEAM_WITH_PWMCTL
+    fprintf(stderr,
+        "\n"
+        "Output control: %s pwmctl get|set|center|info ... (see %s pwmctl --help)\n",
+        argv0, argv0);
+#endif
+    fprintf(stderr, "\nBuilt with: sse=%s log=%s mux=%s uart=%s bpf=%s trace=%s usdt=%s\n"
+            "            ctl=%s inject=%s pattern=%s pwmctl=%s echo=%s mavlink=%s sbus=%s http=%s\n",
+            WAYBEAM_WITH_SSE ? "yes" : "no",
+            WAYBEAM_WITH_LOG ? "yes" : "no",
+            WAYBEAM_WITH_MUX ? "yes" : "no",
+            WAYBEAM_WITH_UART ? "yes" : "no",
+            WAYBEAM_WITH_BPF ? "yes" : "no",
+            WAYBEAM_WITH_TRACE ? "yes" : "no",
+            WAYBEAM_WITH_USDT ? "yes" : "no",
+            WAYBEAM_WITH_CTL ? "yes" : "no",
+            WAYBEAM_WITH_INJECT ? "yes" : "no",
+            WAYBEAM_WITH_PATTERN ? "yes" : "no",
+            WAYBEAM_WITH_PWMCTL ? "yes" : "no",
+            WAYBEAM_WITH_ECHO ? "yes" : "no",
+            WAYBEAM_WITH_MAVLINK ? "yes" : "no",
+            WAYBEAM_WITH_SBUS ? "yes" : "no",
+            WAYBEAM_WITH_HTTP ? "yes" : "no");
 }
 
 static int parse_int(const char *s, int *out) {
@@ -173,6 +933,7 @@ static bool parse_opt_int_or_die(int argc, char **argv, int *i, int *dst, const
     return true;
 }
 
+#if WAYBEAM_WITH_MUX
 static bool parse_opt_u16_or_die(int argc, char **argv, int *i, uint16_t *dst, const char *opt) {
     int tmp = 0;
     if (!parse_opt_int_or_die(argc, argv, i, &tmp, opt)) {
@@ -185,6 +946,66 @@ static bool parse_opt_u16_or_die(int argc, char **argv, int *i, uint16_t *dst, c
     *dst = (uint16_t)tmp;
     return true;
 }
+#endif
+
+// "center", "hold", "US" or "US/RAMP_MS"; range checks happen with the rest of cfg
+static int parse_failsafe_spec(const char *s, int *us, int *ramp_ms, bool *hold) {
+    char buf[32];
+    *us = 0;
+    *ramp_ms = 0;
+    *hold = false;
+    if (!strcmp(s, "center")) return 0;
+    if (!strcmp(s, "hold")) {
+        *hold = true;
+        return 0;
+    }
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        *slash = '\0';
+        if (parse_int(slash + 1, ramp_ms) != 0 || *ramp_ms < 0) return -1;
+    }
+    if (parse_int(buf, us) != 0 || *us <= 0) return -1;
+    return 0;
+}
+
+#if WAYBEAM_WITH_PATTERN
+// "sweep|sine|square:LO-HI:PERIOD_MS" or "step:LO-HI:STEP_US:HOLD_MS";
+// range checks happen in pattern_check()
+static int parse_pattern_spec(const char *s, pattern_t *p) {
+    static const char *const names[] = {
+        [PAT_SWEEP] = "sweep", [PAT_STEP] = "step", [PAT_SINE] = "sine", [PAT_SQUARE] = "square",
+    };
+    char buf[64];
+    char *f[4];
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *tok = buf;
+    while (tok && n < 4) {
+        f[n++] = tok;
+        tok = strchr(tok, ':');
+        if (tok) *tok++ = '\0';
+    }
+    if (tok) return -1;
+    *p = (pattern_t){ .shape = PAT_NONE };
+    for (int k = PAT_SWEEP; k <= PAT_SQUARE; k++) {
+        if (!strcmp(f[0], names[k])) p->shape = k;
+    }
+    if (p->shape == PAT_NONE || n != (p->shape == PAT_STEP ? 4 : 3)) return -1;
+    char *dash = strchr(f[1], '-');
+    if (!dash) return -1;
+    *dash = '\0';
+    if (parse_int(f[1], &p->lo_us) != 0 || parse_int(dash + 1, &p->hi_us) != 0) return -1;
+    if (p->shape == PAT_STEP && parse_int(f[2], &p->step_us) != 0) return -1;
+    return parse_int(f[n - 1], &p->period_ms);
+}
+#endif
+
+static int clampi(int v, int lo, int hi) {
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
 
 static int write_str(const char *path, const char *s) {
     int fd = open(path, O_WRONLY);
@@ -207,131 +1028,433 @@ static bool path_exists(const char *path) {
     return stat(path, &st) == 0;
 }
 
-static int export_pwm_if_needed(int ch) {
+static int export_pwm_if_needed(int chip, int hw) {
     char p[128];
-    snprintf(p, sizeof(p), PWMCHIP "/pwm%d", ch);
+    snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/pwm%d", chip, hw);
     if (path_exists(p)) return 0;
-    return write_int_path(PWMCHIP "/export", ch);
+    snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/export", chip);
+    return write_int_path(p, hw);
+}
+
+// Every pwmchip with its channel count and driver, sorted by number
+static int pwm_chips_scan(pwm_chip_t *chips, int max) {
+    DIR *d = opendir(PWM_CLASS);
+    if (!d) return 0;
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && n < max) {
+        int num;
+        char tail;
+        if (sscanf(de->d_name, "pwmchip%d%c", &num, &tail) != 1 || num < 0) continue;
+        pwm_chip_t *c = &chips[n];
+        char p[192], buf[128];
+        c->num = num;
+        c->npwm = 0;
+        snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/npwm", num);
+        int fd = open(p, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ssize_t r = read(fd, buf, sizeof(buf) - 1);
+            close(fd);
+            if (r > 0) {
+                buf[r] = '\0';
+                c->npwm = atoi(buf);
+            }
+        }
+        snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/device/driver", num);
+        ssize_t r = readlink(p, buf, sizeof(buf) - 1);
+        if (r > 0) {
+            buf[r] = '\0';
+            const char *base = strrchr(buf, '/');
+            base = base ? base + 1 : buf;
+            size_t len = strnlen(base, sizeof(c->driver) - 1); // long names are cut, not rejected
+            memcpy(c->driver, base, len);
+            c->driver[len] = '\0';
+        } else {
+            snprintf(c->driver, sizeof(c->driver), "?");
+        }
+        n++;
+    }
+    closedir(d);
+    for (int i = 1; i < n; i++) {
+        for (int j = i; j > 0 && chips[j - 1].num > chips[j].num; j--) {
+            pwm_chip_t t = chips[j];
+            chips[j] = chips[j - 1];
+            chips[j - 1] = t;
+        }
+    }
+    return n;
+}
+
+static const pwm_chip_t *pwm_chip_find(const pwm_chip_t *chips, int n, int num) {
+    for (int i = 0; i < n; i++) {
+        if (chips[i].num == num) return &chips[i];
+    }
+    return NULL;
+}
+
+static const pwm_chip_t *pwm_chip_by_driver(const pwm_chip_t *chips, int n, const char *driver) {
+    for (int i = 0; i < n; i++) {
+        if (!strcmp(chips[i].driver, driver)) return &chips[i];
+    }
+    return NULL;
+}
+
+// "N:CH" (pwmchipN) or "DRIVER:CH" (first chip bound to DRIVER)
+static int parse_out_addr(const char *s, int *chip, int *hw, char *driver, size_t driver_len) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *colon = strrchr(buf, ':');
+    if (!colon || colon == buf) return -1;
+    *colon = '\0';
+    if (parse_int(colon + 1, hw) != 0 || *hw < 0) return -1;
+    driver[0] = '\0';
+    *chip = -1;
+    if (parse_int(buf, chip) == 0) return *chip >= 0 ? 0 : -1;
+    if (strlen(buf) >= driver_len) return -1;
+    snprintf(driver, driver_len, "%s", buf);
+    return 0;
+}
+
+// Output index for "pwmN" (pwmchip0) or "CHIP:N" written the way its --out
+// was; -1 when no output declared so far matches
+static int parse_out_sel(const cfg_t *cfg, const char *s) {
+    char driver[24] = "";
+    int chip = 0, hw;
+    if (strncmp(s, "pwm", 3) != 0 || parse_int(s + 3, &hw) != 0 || hw < 0) {
+        if (parse_out_addr(s, &chip, &hw, driver, sizeof(driver)) != 0) return -1;
+    }
+    for (int i = 0; i < cfg->out_count; i++) {
+        if (cfg->out_addr[i].hw != hw) continue;
+        if (driver[0] ? !strcmp(cfg->out_addr[i].driver, driver)
+                      : !cfg->out_addr[i].driver[0] && cfg->out_addr[i].chip == chip) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// "OUT=VALUE" of a per-output option: *idx is the output, VALUE is returned;
+// NULL after printing the error
+static const char *parse_out_opt(const cfg_t *cfg, const char *opt, const char *val, int *idx) {
+    const char *eq = strchr(val, '=');
+    char sel[64];
+    if (!eq || eq == val || (size_t)(eq - val) >= sizeof(sel)) {
+        fprintf(stderr, "Invalid value for %s: %s (expected OUT=VALUE)\n", opt, val);
+        return NULL;
+    }
+    snprintf(sel, sizeof(sel), "%.*s", (int)(eq - val), val);
+    *idx = parse_out_sel(cfg, sel);
+    if (*idx < 0) {
+        fprintf(stderr, "%s: no output %s (pwmN or CHIP:N, after its --out)\n", opt, sel);
+        return NULL;
+    }
+    return eq + 1;
+}
+
+#if WAYBEAM_WITH_MUX
+// 16-bit register access through /dev/mem: what BusyBox devmem does, without
+// forking a shell and the applet for every access
+static int sigma_mux_rw(const char *reg, uint16_t *val, bool write) {
+    char *end;
+    errno = 0;
+    unsigned long addr = strtoul(reg, &end, 0);
+    if (errno || end == reg || *end || (addr & 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+    unsigned long base = addr & ~(unsigned long)(pg - 1);
+    int fd = open(DEVMEM, (write ? O_RDWR : O_RDONLY) | O_SYNC | O_CLOEXEC);
+    if (fd < 0) return -1;
+    void *map = mmap(NULL, pg, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, (off_t)base);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    volatile uint16_t *r = (volatile uint16_t *)((char *)map + (addr - base));
+    if (write) {
+        *r = *val;
+    } else {
+        *val = *r;
+    }
+    munmap(map, pg);
+    return 0;
 }
 
 static int sigma_mux_set(const cfg_t *cfg, int pwm_ch) {
     if (cfg->no_mux) {
         return 0;
     }
-    char cmd[128];
     uint16_t val = (pwm_ch == 0) ? cfg->mux_pwm0 : cfg->mux_pwm1;
-    // BusyBox shell-friendly one-shot
-    snprintf(cmd, sizeof(cmd), "devmem %s 16 0x%04x >/dev/null 2>&1", cfg->mux_reg, val);
-    return system(cmd);
+    return sigma_mux_rw(cfg->mux_reg, &val, true);
 }
 
 static int sigma_mux_set_value(const cfg_t *cfg, uint16_t val) {
     if (cfg->no_mux) {
         return 0;
     }
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd), "devmem %s 16 0x%04x >/dev/null 2>&1", cfg->mux_reg, val);
-    return system(cmd);
+    return sigma_mux_rw(cfg->mux_reg, &val, true);
+}
+#endif
+
+// Hand failsafe to the driver: failsafe_us is applied from a kernel timer when
+// duty_us is not refreshed within heartbeat_ms, even if this process is gone.
+static void pwm_arm_heartbeat(const cfg_t *cfg, pwm_out_t *o) {
+    char p[192];
+    char buf[8];
+
+    // The driver has no ramp or hold: it jumps straight to the final value
+    snprintf(p, sizeof(p), "%s/failsafe_us", o->path);
+    if (write_int_path(p, o->failsafe_us) != 0) {
+        fprintf(stderr, "WARN: %s not writable (heartbeat patch missing?), using userspace failsafe\n", p);
+        return;
+    }
+    snprintf(p, sizeof(p), "%s/failsafe_active", o->path);
+    o->fd_failsafe_active = open(p, O_RDONLY);
+    if (o->fd_failsafe_active < 0) {
+        perror("open failsafe_active");
+        return;
+    }
+    // sysfs_notify() only wakes poll() after an initial read
+    (void)pread(o->fd_failsafe_active, buf, sizeof(buf), 0);
+
+    snprintf(p, sizeof(p), "%s/heartbeat_ms", o->path);
+    if (write_int_path(p, cfg->center_timeout_ms) != 0) {
+        perror("write heartbeat_ms");
+        close(o->fd_failsafe_active);
+        o->fd_failsafe_active = -1;
+        return;
+    }
+    o->heartbeat_ms = cfg->center_timeout_ms;
+    if (VERBOSE(cfg)) {
+        fprintf(stderr, "PWM%d kernel failsafe: %dus after %dms without duty_us refresh\n",
+                o->ch, o->failsafe_us, o->heartbeat_ms);
+    }
+}
+
+// Before a clean exit: an armed heartbeat would keep re-applying failsafe_us
+// over every later pwmctl set or infinity6e_pwm.sh write.
+static void pwm_disarm_heartbeat(pwm_out_t *o) {
+    if (!o->available) return; // never set up: zeroed, so fd 0 is not ours
+    if (o->heartbeat_ms) {
+        char p[192];
+        snprintf(p, sizeof(p), "%s/heartbeat_ms", o->path);
+        if (write_int_path(p, 0) != 0) perror("write heartbeat_ms");
+        o->heartbeat_ms = 0;
+    }
+    if (o->fd_failsafe_active >= 0) {
+        close(o->fd_failsafe_active);
+        o->fd_failsafe_active = -1;
+    }
+}
+
+// The duty file stays open: an update is one pwrite(), no path lookup or open/close
+static int pwm_write_duty(pwm_out_t *o, int us) {
+    char buf[16];
+    int n = snprintf(buf, sizeof(buf), "%d", o->backend == PWM_BACKEND_NS ? us * 1000 : us);
+    if (o->fd_duty < 0) return write_str(o->duty_path, buf);
+    return pwrite(o->fd_duty, buf, (size_t)n, 0) == n ? 0 : -1;
 }
 
 static int pwm_init_one(const cfg_t *cfg, pwm_out_t *o, int ch) {
     memset(o, 0, sizeof(*o));
     o->ch = ch;
-    o->fd_duty_us = -1;
+    o->chip = cfg->out_addr[ch].chip;
+    o->hw = cfg->out_addr[ch].hw;
+    o->fd_duty = -1;
     o->fd_period = -1;
     o->fd_enable = -1;
+    o->fd_failsafe_active = -1;
     o->last_us = -1;
+    o->deadband_us = cfg->deadband_us[ch];
+    o->hysteresis_us = cfg->hysteresis_us[ch];
+    o->failsafe_us = cfg->failsafe_us[ch] ? cfg->failsafe_us[ch] : cfg->center_us;
+    o->failsafe_ramp_ms = cfg->failsafe_ramp_ms[ch];
+    o->failsafe_hold = cfg->failsafe_hold[ch];
 
-    snprintf(o->path, sizeof(o->path), PWMCHIP "/pwm%d", ch);
-    snprintf(o->duty_us_path, sizeof(o->duty_us_path), "%s/duty_us", o->path);
-    snprintf(o->duty_pct_path, sizeof(o->duty_pct_path), "%s/duty_cycle", o->path);
+    snprintf(o->path, sizeof(o->path), PWM_CLASS "/pwmchip%d/pwm%d", o->chip, o->hw);
+    snprintf(o->duty_path, sizeof(o->duty_path), "%s/duty_us", o->path);
     snprintf(o->period_path, sizeof(o->period_path), "%s/period", o->path);
     snprintf(o->enable_path, sizeof(o->enable_path), "%s/enable", o->path);
     snprintf(o->polarity_path, sizeof(o->polarity_path), "%s/polarity", o->path);
+    snprintf(o->state_path, sizeof(o->state_path), "%s/state", o->path);
 
-    if (cfg->no_mux) {
-        if (cfg->verbose) {
-            fprintf(stderr, "MUX: skipping write for pwm%d (--no-mux)\n", ch);
+#if WAYBEAM_WITH_MUX
+    // Only the SoC's pwm0/pwm1 pads sit behind the SigmaStar pin mux
+    if (o->chip != 0 || o->hw > 1) {
+        // nothing to mux
+    } else if (cfg->no_mux) {
+        if (VERBOSE(cfg)) {
+            fprintf(stderr, "MUX: skipping write for pwm%d (--no-mux)\n", o->hw);
         }
     } else if (cfg->mux_init_once) {
-        if (cfg->verbose > 1) {
-            fprintf(stderr, "MUX: per-channel write skipped for pwm%d (--mux-init-val active)\n", ch);
+        if (VERBOSE(cfg) > 1) {
+            fprintf(stderr, "MUX: per-channel write skipped for pwm%d (--mux-init-val active)\n", o->hw);
         }
-    } else if (sigma_mux_set(cfg, ch) != 0 && cfg->verbose) {
-        fprintf(stderr, "WARN: devmem mux set failed for pwm%d (continuing)\n", ch);
-    } else if (cfg->verbose > 1) {
-        uint16_t val = (ch == 0) ? cfg->mux_pwm0 : cfg->mux_pwm1;
-        fprintf(stderr, "MUX: pwm%d -> %s = 0x%04x\n", ch, cfg->mux_reg, val);
-    }
-
-    if (export_pwm_if_needed(ch) != 0 && !path_exists(o->path)) {
-        perror("export pwm");
-        return -1;
+    } else if (sigma_mux_set(cfg, o->hw) != 0 && VERBOSE(cfg)) {
+        fprintf(stderr, "WARN: mux write to %s failed for pwm%d: %s (continuing)\n",
+                cfg->mux_reg, o->hw, strerror(errno));
+    } else if (VERBOSE(cfg) > 1) {
+        uint16_t val = (o->hw == 0) ? cfg->mux_pwm0 : cfg->mux_pwm1;
+        fprintf(stderr, "MUX: pwm%d -> %s = 0x%04x\n", o->hw, cfg->mux_reg, val);
     }
+#endif
 
-    // Must have duty_us for fine control (your patched driver)
-    if (!path_exists(o->duty_us_path)) {
-        fprintf(stderr, "ERROR: %s missing (driver patch not present?)\n", o->duty_us_path);
+    if (export_pwm_if_needed(o->chip, o->hw) != 0 && !path_exists(o->path)) {
+        fprintf(stderr, "export pwmchip%d/pwm%d: %s\n", o->chip, o->hw, strerror(errno));
         return -1;
     }
 
-    // Disable -> set period (Hz on this SigmaStar BSP) -> set center -> enable
-    (void)write_int_path(o->enable_path, 0);
-    if (write_int_path(o->period_path, cfg->hz) != 0) {
-        perror("write period");
-        return -1;
-    }
-    if (write_int_path(o->duty_us_path, cfg->center_us) != 0) {
-        perror("write duty_us center");
-        return -1;
+    // Backend per chip: the patched driver's duty_us (period in Hz on this
+    // BSP), else the mainline ABI with period and duty_cycle in ns
+    bool atomic = false;
+    if (path_exists(o->duty_path)) {
+        o->backend = PWM_BACKEND_DUTY_US;
+        // Atomic driver (patch 0004): period, failsafe value, polarity and
+        // enable in one apply. Otherwise: disable -> period -> duty -> enable.
+        char state[64];
+        snprintf(state, sizeof(state), "%d %d normal 1", cfg->hz, o->failsafe_us);
+        atomic = write_str(o->state_path, state) == 0;
+    } else {
+        o->backend = PWM_BACKEND_NS;
+        snprintf(o->duty_path, sizeof(o->duty_path), "%s/duty_cycle", o->path);
     }
-    if (write_int_path(o->enable_path, 1) != 0) {
-        perror("enable pwm");
-        return -1;
+    if (!atomic) {
+        int period = o->backend == PWM_BACKEND_NS ? 1000000000 / cfg->hz : cfg->hz;
+        (void)write_int_path(o->enable_path, 0);
+        if (o->backend == PWM_BACKEND_NS) (void)write_int_path(o->duty_path, 0); // must stay <= period
+        if (write_int_path(o->period_path, period) != 0) {
+            fprintf(stderr, "write %s: %s\n", o->period_path, strerror(errno));
+            return -1;
+        }
+        if (pwm_write_duty(o, o->failsafe_us) != 0) {
+            fprintf(stderr, "write %s failsafe: %s\n", o->duty_path, strerror(errno));
+            return -1;
+        }
+        if (write_int_path(o->enable_path, 1) != 0) {
+            fprintf(stderr, "enable %s: %s\n", o->path, strerror(errno));
+            return -1;
+        }
     }
     o->enabled = true;
-    o->last_us = cfg->center_us;
+    o->last_us = o->failsafe_us;
+    o->last_write_ms = mono_ms();
     o->available = true;
+    o->fd_duty = open(o->duty_path, O_WRONLY | O_CLOEXEC); // -1: per-write open
+
+    if (cfg->kernel_failsafe && (o->failsafe_hold || o->failsafe_ramp_ms > 0)) {
+        // The driver would jump to failsafe_us and switch off the staged failsafe
+        fprintf(stderr, "WARN: PWM%d failsafe %s needs the userspace failsafe, no kernel heartbeat\n",
+                ch, o->failsafe_hold ? "hold" : "ramp");
+    } else if (cfg->kernel_failsafe && o->backend == PWM_BACKEND_DUTY_US) {
+        pwm_arm_heartbeat(cfg, o);
+    } else if (cfg->kernel_failsafe) {
+        fprintf(stderr, "WARN: pwmchip%d has no duty_us heartbeat, PWM%d uses the userspace failsafe\n",
+                o->chip, ch);
+    }
 
-    if (cfg->verbose) {
-        fprintf(stderr, "PWM%d ready: period=%dHz center=%dus (%s)\n",
-                ch, cfg->hz, cfg->center_us, o->duty_us_path);
+    if (VERBOSE(cfg)) {
+        fprintf(stderr, "PWM%d ready: pwmchip%d/pwm%d period=%dHz start=%dus (%s, %s setup)\n",
+                ch, o->chip, o->hw, cfg->hz, o->failsafe_us, o->duty_path,
+                o->backend == PWM_BACKEND_NS ? "ns" : atomic ? "atomic" : "legacy");
     }
     return 0;
 }
 
+// Write path shared by filtered updates and forced (failsafe/centering) updates.
+static void pwm_write_us(const cfg_t *cfg, pwm_out_t *o, int us, int requested_us) {
+    if (pwm_write_duty(o, us) == 0) {
+        if (VERBOSE(cfg) > 1) {
+            if (requested_us != us) {
+                LOGE(EV_PWM_WRITE_CLAMPED, (uint32_t)o->ch, (uint32_t)us, (uint32_t)requested_us);
+            } else {
+                LOGE(EV_PWM_WRITE, (uint32_t)o->ch, (uint32_t)us);
+            }
+        }
+        if (o->last_us >= 0 && us != o->last_us) {
+            o->last_dir = (us > o->last_us) ? 1 : -1;
+        }
+        PROBE(output_commit, "pwm=%d us=%d requested=%d", o->ch, us, requested_us);
+        o->last_us = us;
+        o->writes++;
+        if (o->heartbeat_ms) o->last_write_ms = mono_ms();
+    } else {
+        o->write_errors++;
+        if (VERBOSE(cfg)) {
+            LOGE(EV_PWM_WRITE_FAIL, (uint32_t)o->ch, (uint32_t)us, (uint32_t)errno);
+        }
+    }
+}
+
+// Deadband/hysteresis decision. Small changes are dropped; reversing direction
+// needs deadband + hysteresis. Clamp endpoints always pass so full throw is reachable.
+static bool pwm_filter_suppress(const cfg_t *cfg, const pwm_out_t *o, int us) {
+    if (o->last_us < 0 || us == cfg->min_us || us == cfg->max_us) return false;
+    int delta = us - o->last_us;
+    int dir = (delta > 0) ? 1 : -1;
+    int mag = (delta > 0) ? delta : -delta;
+    int threshold = o->deadband_us;
+    if (o->last_dir != 0 && dir != o->last_dir) threshold += o->hysteresis_us;
+    return mag <= threshold;
+}
+
+// With a driver heartbeat armed, unchanged/suppressed updates still need an
+// occasional write; refreshing at 1/5 of the window bounds early failsafe to 20%.
+static bool pwm_heartbeat_due(const pwm_out_t *o) {
+    return o->heartbeat_ms &&
+           mono_ms() - o->last_write_ms >= (uint64_t)(o->heartbeat_ms / 5);
+}
+
 static void pwm_set_us(const cfg_t *cfg, pwm_out_t *o, int us) {
     int requested_us = us;
     if (!o->available) return;
-    if (us < cfg->min_us) us = cfg->min_us;
-    if (us > cfg->max_us) us = cfg->max_us;
+    us = clampi(us, cfg->min_us, cfg->max_us);
+    if (pwm_heartbeat_due(o) &&
+        (o->last_us == us || pwm_filter_suppress(cfg, o, us))) {
+        pwm_write_us(cfg, o, o->last_us, o->last_us);
+        return;
+    }
     if (o->last_us == us) {
-        if (cfg->verbose > 2) {
-            fprintf(stderr, "PWM%d unchanged: duty_us=%d\n", o->ch, us);
+        o->unchanged++;
+        if (VERBOSE(cfg) > 2) {
+            LOGE(EV_PWM_UNCHANGED, (uint32_t)o->ch, (uint32_t)us);
         }
         return;
     }
-    if (write_int_path(o->duty_us_path, us) == 0) {
-        if (cfg->verbose > 1) {
-            if (requested_us != us) {
-                fprintf(stderr, "PWM%d <- %dus (clamped from %dus)\n", o->ch, us, requested_us);
-            } else {
-                fprintf(stderr, "PWM%d <- %dus\n", o->ch, us);
-            }
+    if (pwm_filter_suppress(cfg, o, us)) {
+        o->suppressed++;
+        if (VERBOSE(cfg) > 2) {
+            LOGE(EV_PWM_SUPPRESSED, (uint32_t)o->ch, (uint32_t)us, (uint32_t)o->last_us,
+                 (uint32_t)o->deadband_us, (uint32_t)o->hysteresis_us);
         }
-        o->last_us = us;
-    } else if (cfg->verbose) {
-        fprintf(stderr, "PWM%d write failed for %s=%d: %s\n",
-                o->ch, o->duty_us_path, us, strerror(errno));
+        return;
+    }
+    pwm_write_us(cfg, o, us, requested_us);
+}
+
+// Bypasses deadband/hysteresis: failsafe and shutdown must always land exactly.
+static void pwm_force_us(const cfg_t *cfg, pwm_out_t *o, int us) {
+    if (!o->available) return;
+    us = clampi(us, cfg->min_us, cfg->max_us);
+    if (o->last_us == us) {
+        o->unchanged++;
+        return;
     }
+    pwm_write_us(cfg, o, us, us);
 }
 
-static void pwm_center_all(const cfg_t *cfg, pwm_out_t *a, pwm_out_t *b) {
-    if (cfg->verbose) {
-        fprintf(stderr, "Centering PWM outputs to %dus\n", cfg->center_us);
+// Final failsafe value with no ramp: startup, socket errors and shutdown
+static void pwm_failsafe_all(const cfg_t *cfg, pwm_out_t *pwm, int n) {
+    if (VERBOSE(cfg)) {
+        LOGE(EV_CENTER, (uint32_t)cfg->center_us);
+    }
+    for (int i = 0; i < n; i++) {
+        if (!pwm[i].failsafe_hold) pwm_force_us(cfg, &pwm[i], pwm[i].failsafe_us);
     }
-    pwm_set_us(cfg, a, cfg->center_us);
-    pwm_set_us(cfg, b, cfg->center_us);
+}
+
+static void pwm_log_stats(const pwm_out_t *o) {
+    if (!o->available) return;
+    fprintf(stderr, "PWM%d stats: writes=%zu suppressed=%zu unchanged=%zu predicted=%zu errors=%zu\n",
+            o->ch, o->writes, o->suppressed, o->unchanged, o->predicted, o->write_errors);
 }
 
 // CRC8 poly 0xD5 (CRSF spec)
@@ -346,6 +1469,19 @@ static uint8_t crsf_crc8(const uint8_t *buf, size_t len) {
     return crc;
 }
 
+#if WAYBEAM_WITH_ECHO
+// CRSF multi-byte fields are big-endian
+static uint64_t get_be(const uint8_t *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static void put_be(uint8_t *p, uint64_t v, int n) {
+    for (int i = n - 1; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+}
+#endif
+
 static int crsf_ticks_to_us(int ticks) {
     // TBS spec macro: TICKS_TO_US(x) ((x - 992) * 5 / 8 + 1500)
     return ((ticks - 992) * 5) / 8 + 1500;
@@ -376,6 +1512,12 @@ typedef struct {
     size_t frames_bad_crc;
     size_t frames_bad_addr;
     size_t rc_frames;
+    size_t rx_failsafe;     // SBUS frames with the failsafe flag, not used as RC
+    size_t rx_lost;         // SBUS frames with the frame-lost flag
+    bool got_probe;         // --echo: last latency probe in this batch
+    uint8_t probe_origin;
+    uint32_t probe_seq;
+    uint64_t probe_tx;      // sender's timestamp, echoed untouched
 } crsf_parse_result_t;
 
 // Feed arbitrary bytes (UDP payload may contain partial/multiple frames)
@@ -431,18 +1573,28 @@ static void crsf_stream_parse(stream_buf_t *sb, crsf_parse_result_t *res, int ve
             continue;
         }
         res->frames_crc_ok++;
+        PROBE(frame_valid, "type=0x%02x len=%u", (unsigned)type, (unsigned)total);
 
         if (type == CRSF_TYPE_RC_CHANNELS_PACKED) {
             if (payload_len == 22 && crsf_unpack_rc16_11bit(payload, payload_len, res->ch_us)) {
                 res->got_rc = true;
                 res->rc_frames++;
                 if (verbose > 1) {
-                    fprintf(stderr, "CRSF RC frame parsed\n");
+                    LOGE(EV_CRSF_RC, 0);
                 }
             } else if (verbose > 1) {
-                fprintf(stderr, "CRSF RC frame ignored: invalid payload_len=%zu\n", payload_len);
+                LOGE(EV_CRSF_RC_BAD_LEN, (uint32_t)payload_len);
             }
         }
+#if WAYBEAM_WITH_ECHO
+        // dest, origin, seq (be32), sender timestamp (be64)
+        if (type == CRSF_TYPE_LATENCY_PROBE && payload_len == 14) {
+            res->got_probe = true;
+            res->probe_origin = payload[1];
+            res->probe_seq = (uint32_t)get_be(&payload[2], 4);
+            res->probe_tx = get_be(&payload[6], 8);
+        }
+#endif
 
         i += total;
     }
@@ -453,288 +1605,2561 @@ static void crsf_stream_parse(stream_buf_t *sb, crsf_parse_result_t *res, int ve
     }
 }
 
-static int clampi(int v, int lo, int hi) {
-    if (v < lo) return lo;
-    if (v > hi) return hi;
-    return v;
-}
-
-static void log_udp_rx(int verbose, ssize_t n, const struct sockaddr_in *src, const crsf_parse_result_t *res) {
-    char ipbuf[INET_ADDRSTRLEN] = "?";
-    if (src) {
-        (void)inet_ntop(AF_INET, &src->sin_addr, ipbuf, sizeof(ipbuf));
-    }
-    unsigned int port = src ? (unsigned int)ntohs(src->sin_port) : 0U;
+#if WAYBEAM_WITH_MAVLINK
+#define MAV_STX_V1 0xFE
+#define MAV_STX_V2 0xFD
+#define MAV_IFLAG_SIGNED 0x01
+#define MAV_SIGNATURE_LEN 13
+#define MAV_MSG_HEARTBEAT 0
+#define MAV_MSG_RC_CHANNELS 65
+#define MAV_MSG_RC_CHANNELS_OVERRIDE 70
 
-    if (verbose > 1) {
-        fprintf(stderr,
-                "UDP rx: %zd bytes from %s:%u | frames=%zu crc_ok=%zu rc=%zu bad_addr=%zu bad_crc=%zu\n",
-                n, ipbuf, port,
-                res->frames_seen, res->frames_crc_ok, res->rc_frames,
-                res->frames_bad_addr, res->frames_bad_crc);
-    } else {
-        fprintf(stderr, "UDP rx: %zd bytes from %s:%u%s\n",
-                n, ipbuf, port, res->got_rc ? " (RC update)" : " (no RC)");
-    }
+// X.25 CRC-16/MCRF4XX as in the MAVLink C library (crc_accumulate)
+static uint16_t mav_crc_accumulate(uint16_t crc, uint8_t b) {
+    uint8_t tmp = b ^ (uint8_t)crc;
+    tmp ^= (uint8_t)(tmp << 4);
+    return (uint16_t)((crc >> 8) ^ ((uint16_t)tmp << 8) ^ ((uint16_t)tmp << 3) ^ (tmp >> 4));
 }
 
-// ---------------------------------------------------------------------------
-// SSE server (adapted from joystick2crsf)
-// ---------------------------------------------------------------------------
+// CRC_EXTRA and payload lengths (v1 without extensions, v2 with) of the
+// messages that are checked; anything else is skipped by its length field
+static const struct {
+    uint32_t msgid;
+    uint8_t crc_extra;
+    uint8_t len_v1;
+    uint8_t len;
+} mav_msgs[] = {
+    { MAV_MSG_HEARTBEAT, 50, 9, 9 },
+    { MAV_MSG_RC_CHANNELS, 118, 42, 42 },
+    { MAV_MSG_RC_CHANNELS_OVERRIDE, 124, 18, 38 },
+};
 
-static int set_nonblock(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags < 0) return -1;
-    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+static uint16_t mav_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
 }
 
-static int sse_send_all(int fd, const char *buf, size_t len) {
-    size_t off = 0;
-    while (off < len) {
-        ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
-        if (n > 0) { off += (size_t)n; continue; }
-        if (n == 0) return -1;
-        if (errno == EINTR) continue;
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return (off == 0) ? 1 : -1;
+// Copy the channels a message sets into ch_us; the rest keep their value.
+// RC_CHANNELS_OVERRIDE: 0 and UINT16_MAX (and UINT16_MAX - 1 for 9..18)
+// mean "not overridden". RC_CHANNELS: UINT16_MAX is unused, chancount caps.
+static int mav_decode_rc(uint32_t msgid, const uint8_t *p, int ch_us[16]) {
+    int set = 0;
+    for (int c = 0; c < 16; c++) {
+        uint16_t v;
+        if (msgid == MAV_MSG_RC_CHANNELS_OVERRIDE) {
+            // chan1..8 at 0, then target system/component, chan9..18 from 18
+            v = mav_u16(c < 8 ? &p[c * 2] : &p[18 + (c - 8) * 2]);
+            if (v == 0 || v == UINT16_MAX || (c >= 8 && v == UINT16_MAX - 1)) continue;
+        } else {
+            // time_boot_ms, chan1..18, chancount at 40
+            if (c >= p[40]) break;
+            v = mav_u16(&p[4 + c * 2]);
+            if (v == UINT16_MAX) continue;
         }
-        return -1;
+        ch_us[c] = v;
+        set++;
     }
-    return 0;
+    return set;
 }
 
-static int open_sse_listener(const char *host, int port) {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) { perror("sse socket"); return -1; }
+// Same contract as crsf_stream_parse(): v1 and v2 frames, partial frames
+// wait for more bytes, the CRC includes CRC_EXTRA, v2 zero-truncated
+// payloads are zero-extended. v2 signatures are skipped, not verified.
+static void mavlink_stream_parse(stream_buf_t *sb, crsf_parse_result_t *res, int verbose) {
+    size_t i = 0;
+    while (sb->len - i >= 8) { // shortest v1 frame
+        const uint8_t *f = &sb->data[i];
+        bool v2 = f[0] == MAV_STX_V2;
+        if (!v2 && f[0] != MAV_STX_V1) {
+            res->frames_bad_addr++;
+            i++;
+            continue;
+        }
+        size_t hdr = v2 ? 10 : 6;
+        if (sb->len - i < hdr) break;
+        uint8_t plen = f[1];
+        size_t total = hdr + plen + 2;
+        if (v2 && (f[2] & MAV_IFLAG_SIGNED)) total += MAV_SIGNATURE_LEN;
+        if (sb->len - i < total) break;  // wait for more bytes
 
-    int one = 1;
-    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        uint32_t msgid = v2 ? (uint32_t)f[7] | ((uint32_t)f[8] << 8) | ((uint32_t)f[9] << 16) : f[5];
+        int m = -1;
+        for (size_t k = 0; k < sizeof(mav_msgs) / sizeof(mav_msgs[0]); k++) {
+            if (mav_msgs[k].msgid == msgid) m = (int)k;
+        }
+        if (m < 0) {
+            // Without a CRC extra the frame cannot be verified: a stray STX in
+            // telemetry must not skip a whole bogus length of real frames
+            i++;
+            continue;
+        }
+        res->frames_seen++;
+
+        uint16_t crc = 0xFFFF;
+        for (size_t k = 1; k < hdr + plen; k++) crc = mav_crc_accumulate(crc, f[k]);
+        crc = mav_crc_accumulate(crc, mav_msgs[m].crc_extra);
+        if (crc != mav_u16(&f[hdr + plen]) || plen > mav_msgs[m].len || (!v2 && plen != mav_msgs[m].len_v1)) {
+            res->frames_bad_crc++;
+            i++;
+            continue;
+        }
+        res->frames_crc_ok++;
+        PROBE(frame_valid, "type=0x%02x len=%u", (unsigned)msgid, (unsigned)total);
+
+        if (msgid == MAV_MSG_RC_CHANNELS || msgid == MAV_MSG_RC_CHANNELS_OVERRIDE) {
+            uint8_t payload[42] = { 0 };
+            memcpy(payload, &f[hdr], plen);
+            int set = mav_decode_rc(msgid, payload, res->ch_us);
+            if (set > 0) {
+                res->got_rc = true;
+                res->rc_frames++;
+            }
+            if (verbose > 1) {
+                LOGE(EV_MAV_RC, msgid, (uint32_t)(v2 ? f[5] : f[3]), (uint32_t)set); // sysid
+            }
+        }
+        i += total;
+    }
+
+    if (i > 0) {
+        memmove(sb->data, sb->data + i, sb->len - i);
+        sb->len -= i;
+    }
+}
+#endif
+
+#if WAYBEAM_WITH_SBUS
+// Fixed-length serial receiver frames: a sync byte, then len - 1 bytes that
+// check() accepts. decode() returns RX_* flags and leaves ch_us untouched
+// when the receiver reports failsafe.
+typedef struct {
+    uint8_t sync;
+    uint8_t len;
+    bool (*check)(const uint8_t *f);
+    int (*decode)(const uint8_t *f, int ch_us[16]);
+} rx_frame_fmt_t;
+
+#define SBUS_SYNC 0x0F
+#define SBUS_FRAME_LEN 25
+#define SBUS_FLAG_FRAME_LOST 0x04
+#define SBUS_FLAG_FAILSAFE 0x08
+#define IBUS_SYNC 0x20           // also the frame length
+#define IBUS_CMD_CHANNELS 0x40
+#define IBUS_FRAME_LEN 32
+
+// No checksum: unused flag bits must be clear and the end byte is 0x00, or
+// 0x04/0x14/0x24/0x34 for the SBUS2 telemetry slots
+static bool sbus_check(const uint8_t *f) {
+    return (f[23] & 0xF0) == 0 && (f[24] == 0x00 || (f[24] & 0xCF) == 0x04);
+}
+
+// Same 16 x 11-bit packing and tick scale as CRSF RC_CHANNELS_PACKED;
+// the digital channels 17/18 (flag bits 0/1) are not mapped
+static int sbus_decode(const uint8_t *f, int ch_us[16]) {
+    int flags = (f[23] & SBUS_FLAG_FRAME_LOST) ? RX_FRAME_LOST : 0;
+    if (f[23] & SBUS_FLAG_FAILSAFE) return flags | RX_FAILSAFE;
+    crsf_unpack_rc16_11bit(&f[1], 22, ch_us);
+    return flags;
+}
+
+// 0xFFFF minus the sum of everything before the checksum, little-endian
+static bool ibus_check(const uint8_t *f) {
+    uint16_t sum = 0xFFFF;
+    if (f[1] != IBUS_CMD_CHANNELS) return false;
+    for (int k = 0; k < IBUS_FRAME_LEN - 2; k++) sum = (uint16_t)(sum - f[k]);
+    return sum == (uint16_t)(f[30] | (f[31] << 8));
+}
+
+// 14 channels in us as u16 with 12 significant bits; 18-channel receivers
+// put channels 15..18 in the top nibbles, three per channel, low first.
+// IBUS has no failsafe flag: receivers send their failsafe values instead.
+static int ibus_decode(const uint8_t *f, int ch_us[16]) {
+    for (int c = 0; c < 14; c++) {
+        ch_us[c] = (f[2 + c * 2] | (f[3 + c * 2] << 8)) & 0x0FFF;
+    }
+    for (int c = 14; c < 16; c++) {
+        const uint8_t *w = &f[2 + (c - 14) * 6];
+        int v = (w[1] >> 4) | (w[3] & 0xF0) | ((w[5] & 0xF0) << 4);
+        if (v) ch_us[c] = v;
+    }
+    return 0;
+}
+
+static const rx_frame_fmt_t sbus_fmt = { SBUS_SYNC, SBUS_FRAME_LEN, sbus_check, sbus_decode };
+static const rx_frame_fmt_t ibus_fmt = { IBUS_SYNC, IBUS_FRAME_LEN, ibus_check, ibus_decode };
+
+// Same contract as crsf_stream_parse() for any rx_frame_fmt_t: resync one
+// byte at a time, partial frames wait for more bytes
+static void fixed_stream_parse(const rx_frame_fmt_t *fmt, int proto, stream_buf_t *sb,
+                               crsf_parse_result_t *res, int verbose) {
+    size_t i = 0;
+    while (sb->len - i >= fmt->len) {
+        const uint8_t *f = &sb->data[i];
+        if (f[0] != fmt->sync) {
+            res->frames_bad_addr++;
+            i++;
+            continue;
+        }
+        res->frames_seen++;
+        if (!fmt->check(f)) {
+            res->frames_bad_crc++;
+            i++;
+            continue;
+        }
+        res->frames_crc_ok++;
+        PROBE(frame_valid, "type=0x%02x len=%u", (unsigned)fmt->sync, (unsigned)fmt->len);
+
+        int flags = fmt->decode(f, res->ch_us);
+        if (flags & RX_FRAME_LOST) res->rx_lost++;
+        if (flags & RX_FAILSAFE) {
+            res->rx_failsafe++;
+        } else {
+            res->got_rc = true;
+            res->rc_frames++;
+        }
+        if (verbose > 1) {
+            LOGE(EV_RX_FRAME, (uint32_t)proto, (uint32_t)flags);
+        }
+        i += fmt->len;
+    }
+    (void)proto;
+
+    if (i > 0) {
+        memmove(sb->data, sb->data + i, sb->len - i);
+        sb->len -= i;
+    }
+}
+#endif
+
+#if WAYBEAM_WITH_LOG
+static void log_udp_rx(int verbose, ssize_t n, const struct sockaddr_in *src, const crsf_parse_result_t *res) {
+    uint32_t ip = src ? (uint32_t)src->sin_addr.s_addr : 0U;
+    uint32_t port = src ? (uint32_t)ntohs(src->sin_port) : 0U;
+
+    if (verbose > 1) {
+        LOGE(EV_UDP_RX_STATS, (uint32_t)n, ip, port,
+             (uint32_t)res->frames_seen, (uint32_t)res->frames_crc_ok, (uint32_t)res->rc_frames,
+             (uint32_t)res->frames_bad_addr, (uint32_t)res->frames_bad_crc);
+    } else {
+        LOGE(EV_UDP_RX, (uint32_t)n, ip, port, res->got_rc ? 1U : 0U);
+    }
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Link-quality estimator, fed once per RC update. Interval and jitter are
+// EWMAs (gain 1/16, kept x16) updated in O(1); p50/p95 and loss come from a
+// ring of the last LINKQ_WINDOW intervals, sorted once per window. CRSF has
+// no sequence numbers, so loss counts the frames a long gap stands in for.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint64_t last_us;            // previous RC update, 0 = none since (re)start
+    uint32_t ring[LINKQ_WINDOW];
+    unsigned filled;
+    unsigned idx;
+    uint32_t interval_x16;       // EWMA interval, us x16
+    uint32_t jitter_x16;         // EWMA |interval - mean|, us x16
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t loss_permille;
+    int hold_ms;                 // effective thresholds, cfg values until the first window
+    int center_ms;
+} linkq_t;
+
+static void linkq_init(linkq_t *q, const cfg_t *cfg) {
+    memset(q, 0, sizeof(*q));
+    q->hold_ms = cfg->hold_ms;
+    q->center_ms = cfg->center_timeout_ms;
+}
+
+static void linkq_refresh(linkq_t *q, const cfg_t *cfg) {
+    uint32_t sorted[LINKQ_WINDOW];
+    memcpy(sorted, q->ring, sizeof(sorted));
+    for (int i = 1; i < LINKQ_WINDOW; i++) {
+        uint32_t v = sorted[i];
+        int j = i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    q->p50_us = sorted[LINKQ_WINDOW / 2];
+    q->p95_us = sorted[(LINKQ_WINDOW * 95) / 100];
+
+    uint32_t missed = 0;
+    for (int i = 0; q->p50_us && i < LINKQ_WINDOW; i++) {
+        if (q->ring[i] > q->p50_us + q->p50_us / 2) {
+            missed += (q->ring[i] + q->p50_us / 2) / q->p50_us - 1;
+        }
+    }
+    q->loss_permille = (missed * 1000U) / (missed + LINKQ_WINDOW);
+
+    if (!cfg->adaptive_timeouts) return;
+    int hold = clampi((int)(((uint64_t)q->p95_us * (uint64_t)cfg->adaptive_hold_x + 999) / 1000),
+                      cfg->adaptive_min_ms, cfg->adaptive_max_ms);
+    int center = clampi((int)(((uint64_t)q->p95_us * (uint64_t)cfg->adaptive_center_x + 999) / 1000),
+                        cfg->adaptive_min_ms, cfg->adaptive_max_ms);
+    if (center < hold) center = hold;
+    if (hold != q->hold_ms || center != q->center_ms) {
+        q->hold_ms = hold;
+        q->center_ms = center;
+        if (VERBOSE(cfg)) {
+            LOGE(EV_LINKQ, q->p50_us, q->p95_us, q->jitter_x16 / 16, q->loss_permille,
+                 (uint32_t)hold, (uint32_t)center);
+        }
+    }
+}
+
+// gap: the previous update was before a failsafe, so the interval is an outage
+static void linkq_update(linkq_t *q, const cfg_t *cfg, uint64_t now_us, bool gap) {
+    uint64_t prev = q->last_us;
+    q->last_us = now_us;
+    if (!prev || gap) return;
+
+    uint32_t iv = (uint32_t)(now_us - prev > UINT32_MAX ? UINT32_MAX : now_us - prev);
+    if (!q->interval_x16) {
+        q->interval_x16 = iv * 16U;
+    } else {
+        uint32_t mean = q->interval_x16 / 16;
+        uint32_t dev = iv > mean ? iv - mean : mean - iv;
+        q->interval_x16 = q->interval_x16 - q->interval_x16 / 16 + iv;
+        q->jitter_x16 = q->jitter_x16 - q->jitter_x16 / 16 + dev;
+    }
+
+    q->ring[q->idx] = iv;
+    q->idx = (q->idx + 1) % LINKQ_WINDOW;
+    if (q->filled < LINKQ_WINDOW) q->filled++;
+    if (q->filled == LINKQ_WINDOW && q->idx == 0) linkq_refresh(q, cfg);
+}
+
+// ---------------------------------------------------------------------------
+// Predictive hold, one alpha-beta tracker per output (linear is alpha = beta =
+// 1, i.e. the slope of the last two frames). Real frames always pass through
+// unfiltered; the tracker only supplies the velocity. Once a frame is late,
+// the output follows last + v * t for the horizon, then decays back to the
+// held value by 2x horizon (or hold_ms). The first real frame after a gap
+// starts from the predicted value and halves the difference every frame.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    float x;                // tracked position, us
+    float v;                // tracked velocity, us per ms
+    int last_us;            // last real (mapped, clamped) value
+    uint64_t last_rx_us;
+    int blend_us;           // predicted - real offset still being blended out
+    bool primed;            // has a velocity estimate
+    bool active;            // extrapolating right now
+} predict_t;
+
+// shown_us: what the output shows now, without any additive offset
+static int predict_observe(predict_t *p, const cfg_t *cfg, int shown_us, int us, uint64_t now_us) {
+    if (p->active) {
+        p->blend_us = shown_us - us;
+        p->active = false;
+    } else {
+        p->blend_us /= 2;
+    }
+
+    if (p->last_rx_us && now_us > p->last_rx_us) {
+        static const float gains[][2] = { [PREDICT_LINEAR] = { 1.0f, 1.0f }, [PREDICT_AB] = { 0.5f, 0.1f } };
+        float dt = (float)(now_us - p->last_rx_us) / 1000.0f;
+        float xp = p->x + p->v * dt;
+        float res = (float)us - xp;
+        p->x = xp + gains[cfg->predict][0] * res;
+        p->v += gains[cfg->predict][1] * res / dt;
+        p->primed = true;
+    } else {
+        p->x = (float)us;
+        p->v = 0.0f;
+    }
+    p->last_us = us;
+    p->last_rx_us = now_us;
+    return us + p->blend_us;
+}
+
+// After a failsafe the old motion is meaningless
+static void predict_reset(predict_t *p) {
+    memset(p, 0, sizeof(*p));
+}
+
+// Output at gap_ms into a gap: out to the horizon, then back to hold
+static int predict_at(const predict_t *p, const cfg_t *cfg, int gap_ms, int hold_ms) {
+    int horizon = cfg->predict_horizon_ms;
+    if (horizon > hold_ms / 2) horizon = hold_ms / 2;
+    if (horizon <= 0 || gap_ms >= 2 * horizon) return p->last_us;
+
+    float t = gap_ms <= horizon ? (float)gap_ms : (float)(2 * horizon - gap_ms);
+    int offset = (int)(p->v * t);
+    offset = clampi(offset, -cfg->predict_max_us, cfg->predict_max_us);
+    return clampi(p->last_us + offset, cfg->min_us, cfg->max_us);
+}
+
+// ---------------------------------------------------------------------------
+// RC -> PWM bridge, shared by every CRSF input (UDP, UART)
+// ---------------------------------------------------------------------------
+
+// Per-channel override or additive offset from --inject or --ctl. A write
+// takes the slot when it is free, expired or held at the same or a lower
+// priority, so a stale low-priority injector cannot pin a channel.
+typedef struct {
+    int us;                  // override value or offset, 0 = none
+    int prio;
+    uint64_t until_ms;       // 0 = until released
+} inject_slot_t;
+
+static bool inject_live(const inject_slot_t *sl, uint64_t now) {
+    return sl->us && (!sl->until_ms || now < sl->until_ms);
+}
+
+#if WAYBEAM_WITH_CTL || WAYBEAM_WITH_INJECT || WAYBEAM_WITH_HTTP
+static bool inject_set(inject_slot_t *sl, int us, int prio, uint32_t ttl_ms, uint64_t now) {
+    if (inject_live(sl, now) && prio < sl->prio) return false;
+    sl->us = us;
+    sl->prio = prio;
+    sl->until_ms = us && ttl_ms ? now + ttl_ms : 0;
+    return true;
+}
+#endif
+
+typedef struct {
+    const cfg_t *cfg;
+    pwm_out_t *pwm;          // [n_out]
+    int n_out;
+    uint8_t order[MAX_OUTPUTS]; // commit order, grouped by chip
+    uint64_t last_valid_ms;
+    bool link_active;
+    bool centered;           // outputs in failsafe after timeout/error (true at startup)
+    size_t total_rc_frames;
+    int last_ch_us[16];      // as received, before overrides
+    inject_slot_t ovr[16];   // replaces the channel before mapping
+    inject_slot_t add[16];   // added to the output after prediction
+    bool forced_failsafe;    // control socket holds the outputs in failsafe
+    linkq_t lq;
+    predict_t pred[MAX_OUTPUTS];
+    struct {
+        bool active;
+        int from_us;
+        uint64_t start_ms;
+        uint64_t next_ms;    // next write, one per PWM period
+    } ramp[MAX_OUTPUTS];
+} bridge_t;
+
+static int bridge_output_ch(const bridge_t *b, int idx) {
+    return b->cfg->out_ch[idx];
+}
+
+// A frame's writes go out chip by chip, so each chip gets its updates back
+// to back (one I2C burst on an expander) instead of interleaved
+static void bridge_set_outputs(bridge_t *b, pwm_out_t *pwm, int n) {
+    b->pwm = pwm;
+    b->n_out = n;
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        for (; j > 0 && pwm[b->order[j - 1]].chip > pwm[i].chip; j--) b->order[j] = b->order[j - 1];
+        b->order[j] = (uint8_t)i;
+    }
+}
+
+static void bridge_predict_reset_all(bridge_t *b) {
+    for (int idx = 0; idx < b->n_out; idx++) predict_reset(&b->pred[idx]);
+}
+
+// Live additive offset of the channel an output follows
+static int bridge_offset_us(const bridge_t *b, int crsf_ch, uint64_t now) {
+    if (crsf_ch <= 0) return 0;
+    const inject_slot_t *sl = &b->add[crsf_ch - 1];
+    return inject_live(sl, now) ? sl->us : 0;
+}
+
+// observe = false re-commits the last frame (injection or control socket
+// change) without feeding the predictor a sample that is not a new frame
+static void bridge_map_output(bridge_t *b, const int ch_us[16], int idx, uint64_t now_us, bool observe) {
+    pwm_out_t *o = &b->pwm[idx];
+    int crsf_ch = bridge_output_ch(b, idx);
+    if (crsf_ch <= 0 || !o->available) return;
+
+    int raw_us = ch_us[crsf_ch - 1];
+    int clamped_us = clampi(raw_us, b->cfg->min_us, b->cfg->max_us);
+    int offset_us = bridge_offset_us(b, crsf_ch, now_us / 1000);
+    if (VERBOSE(b->cfg) > 1) {
+        LOGE(EV_MAP, (uint32_t)crsf_ch, (uint32_t)raw_us, (uint32_t)idx, (uint32_t)clamped_us);
+    }
+    if (b->cfg->predict && observe) {
+        clamped_us = predict_observe(&b->pred[idx], b->cfg, o->last_us - offset_us, clamped_us, now_us);
+    } else if (b->cfg->predict) {
+        clamped_us += b->pred[idx].blend_us; // same value the last frame committed
+    }
+    pwm_set_us(b->cfg, o, clamped_us + offset_us);
+}
+
+// Received channels with the live overrides on top
+static void bridge_channels(const bridge_t *b, const int in_us[16], int out_us[16], uint64_t now) {
+    for (int i = 0; i < 16; i++) {
+        out_us[i] = inject_live(&b->ovr[i], now) ? b->ovr[i].us : in_us[i];
+    }
+}
+
+// Frame interval the predictor schedules against, 0 until one is known
+static uint32_t bridge_frame_interval_us(const bridge_t *b) {
+    return b->lq.p50_us ? b->lq.p50_us : b->lq.interval_x16 / 16;
+}
+
+// Runs every loop pass while the link is up: extrapolates outputs whose
+// frame is late, and settles them on the held value once hold_ms is over.
+static void bridge_predict_tick(bridge_t *b, uint64_t now_us) {
+    const cfg_t *cfg = b->cfg;
+    uint32_t interval = bridge_frame_interval_us(b);
+    if (!interval) return;
+
+    for (int idx = 0; idx < b->n_out; idx++) {
+        predict_t *p = &b->pred[idx];
+        pwm_out_t *o = &b->pwm[idx];
+        if (!o->available || !p->primed) continue;
+
+        uint64_t gap_us = now_us - p->last_rx_us;
+        if (gap_us <= (uint64_t)interval + interval / 2) continue;
+
+        int gap_ms = (int)(gap_us / 1000);
+        int offset_us = bridge_offset_us(b, bridge_output_ch(b, idx), now_us / 1000);
+        if (gap_ms >= b->lq.hold_ms) {
+            if (p->active) {
+                pwm_set_us(cfg, o, p->last_us + offset_us);
+                p->active = false;
+            }
+            continue;
+        }
+        int us = predict_at(p, cfg, gap_ms, b->lq.hold_ms) + offset_us;
+        p->active = true;
+        if (us != o->last_us) {
+            o->predicted++;
+            if (VERBOSE(cfg) > 1) {
+                LOGE(EV_PREDICT, (uint32_t)idx, (uint32_t)us, (uint32_t)p->last_us, (uint32_t)gap_ms);
+            }
+        }
+        pwm_set_us(cfg, o, us);
+    }
+}
+
+// Loop tick while predicting: one frame interval, so outputs stay on schedule
+static int bridge_predict_timeout_ms(const bridge_t *b) {
+    uint32_t interval = bridge_frame_interval_us(b);
+    if (!b->cfg->predict || !b->link_active || b->centered || !interval) return -1;
+    return interval < 1000 ? 1 : (int)(interval / 1000);
+}
+
+// Staged failsafe, per output: hold (the hold_ms..center window, already
+// behind us here) -> ramp from the last value to failsafe_us -> final value.
+// A failsafe_hold output stays where it is.
+static void bridge_failsafe_begin(bridge_t *b, uint64_t now) {
+    const cfg_t *cfg = b->cfg;
+    if (VERBOSE(cfg)) LOGE(EV_CENTER, (uint32_t)cfg->center_us);
+
+    for (int idx = 0; idx < b->n_out; idx++) {
+        pwm_out_t *o = &b->pwm[idx];
+        if (!o->available) continue;
+        if (o->failsafe_hold) {
+            if (VERBOSE(cfg)) LOGE(EV_FS_STAGE, (uint32_t)idx, FS_STAGE_HOLD, (uint32_t)o->last_us);
+        } else if (o->failsafe_ramp_ms > 0 && o->last_us != o->failsafe_us) {
+            b->ramp[idx].active = true;
+            b->ramp[idx].from_us = o->last_us;
+            b->ramp[idx].start_ms = now;
+            b->ramp[idx].next_ms = now;
+            if (VERBOSE(cfg)) {
+                LOGE(EV_FS_STAGE, (uint32_t)idx, FS_STAGE_RAMP, (uint32_t)o->failsafe_us,
+                     (uint32_t)o->failsafe_ramp_ms);
+            }
+        } else {
+            pwm_force_us(cfg, o, o->failsafe_us);
+            if (VERBOSE(cfg)) LOGE(EV_FS_STAGE, (uint32_t)idx, FS_STAGE_FINAL, (uint32_t)o->failsafe_us);
+        }
+    }
+}
+
+// One write per PWM period while ramping: anything faster never reaches the pin
+static void bridge_failsafe_tick(bridge_t *b, uint64_t now) {
+    const cfg_t *cfg = b->cfg;
+    uint64_t period_ms = (uint64_t)(1000 / cfg->hz);
+    if (!period_ms) period_ms = 1;
+
+    for (int idx = 0; idx < b->n_out; idx++) {
+        pwm_out_t *o = &b->pwm[idx];
+        if (!b->ramp[idx].active || now < b->ramp[idx].next_ms) continue;
+
+        uint64_t elapsed = now - b->ramp[idx].start_ms;
+        int from = b->ramp[idx].from_us;
+        int us;
+        if (elapsed >= (uint64_t)o->failsafe_ramp_ms) {
+            us = o->failsafe_us;
+            b->ramp[idx].active = false;
+            if (VERBOSE(cfg)) LOGE(EV_FS_STAGE, (uint32_t)idx, FS_STAGE_FINAL, (uint32_t)us);
+        } else {
+            us = from + (int)(((int64_t)(o->failsafe_us - from) * (int64_t)elapsed) / o->failsafe_ramp_ms);
+        }
+        pwm_force_us(cfg, o, us);
+        b->ramp[idx].next_ms += period_ms;
+        if (b->ramp[idx].next_ms <= now) b->ramp[idx].next_ms = now + period_ms;
+    }
+}
+
+// ms until the next ramp step, -1 when no ramp is running
+static int bridge_failsafe_timeout_ms(const bridge_t *b, uint64_t now) {
+    int t = -1;
+    for (int idx = 0; idx < b->n_out; idx++) {
+        if (!b->ramp[idx].active) continue;
+        int left = b->ramp[idx].next_ms > now ? (int)(b->ramp[idx].next_ms - now) : 0;
+        if (t < 0 || left < t) t = left;
+    }
+    return t;
+}
+
+static void bridge_apply_rc(bridge_t *b, const crsf_parse_result_t *res, uint64_t now) {
+    const cfg_t *cfg = b->cfg;
+    if (!res->got_rc) return;
+
+    if (b->forced_failsafe) {
+        // Keep the link state current; outputs resume with the first
+        // frame after the control socket releases them
+        b->last_valid_ms = now;
+        b->link_active = true;
+        b->total_rc_frames += res->rc_frames;
+        memcpy(b->last_ch_us, res->ch_us, sizeof(b->last_ch_us));
+        return;
+    }
+
+    uint64_t now_us = mono_us();
+    linkq_update(&b->lq, cfg, now_us, b->centered);
+    if (b->centered) {
+        bridge_predict_reset_all(b);
+        for (int idx = 0; idx < b->n_out; idx++) b->ramp[idx].active = false;
+        if (VERBOSE(cfg)) LOGE(EV_LINK_RECOVERED, 0);
+        // outage_ms=0: first link since startup
+        PROBE(failsafe_exit, "outage_ms=%llu",
+              (unsigned long long)(b->last_valid_ms ? now - b->last_valid_ms : 0));
+    }
+    PROBE(rc_decoded, "frames=%u ch1=%d ch2=%d ch3=%d ch4=%d", (unsigned)res->rc_frames,
+          res->ch_us[0], res->ch_us[1], res->ch_us[2], res->ch_us[3]);
+    b->last_valid_ms = now;
+    b->link_active = true;
+    b->centered = false;
+    b->total_rc_frames += res->rc_frames;
+    memcpy(b->last_ch_us, res->ch_us, sizeof(b->last_ch_us));
+
+    int ch_us[16];
+    bridge_channels(b, res->ch_us, ch_us, now);
+    for (int k = 0; k < b->n_out; k++) bridge_map_output(b, ch_us, b->order[k], now_us, true);
+
+    if (VERBOSE(cfg) > 1) {
+        LOGE(EV_RC_SUMMARY,
+             (uint32_t)cfg->out_ch[0], (uint32_t)(cfg->out_ch[0] ? ch_us[cfg->out_ch[0] - 1] : 0),
+             (uint32_t)cfg->out_ch[1], (uint32_t)(cfg->out_ch[1] ? ch_us[cfg->out_ch[1] - 1] : 0));
+    }
+}
+
+#if WAYBEAM_WITH_CTL || WAYBEAM_WITH_INJECT || WAYBEAM_WITH_HTTP
+// Re-commit the last frame after an injection or control socket change, so
+// it lands now rather than with the next frame. Failsafe wins. step: a new
+// mapping, limit or override is not motion, so the predictors start over.
+// Outputs the predictor is extrapolating take new offsets from its tick.
+static void bridge_remap(bridge_t *b, uint64_t now, bool step) {
+    if (!b->link_active || b->centered) return;
+    int ch_us[16];
+    uint64_t now_us = mono_us();
+    if (step) bridge_predict_reset_all(b);
+    bridge_channels(b, b->last_ch_us, ch_us, now);
+    for (int k = 0; k < b->n_out; k++) {
+        int idx = b->order[k];
+        if (!b->pred[idx].active) bridge_map_output(b, ch_us, idx, now_us, false);
+    }
+    if (b->cfg->predict) bridge_predict_tick(b, now_us);
+}
+#endif
+
+// --proto formats. baud and format are the UART defaults (--uart-baud
+// overrides the rate); fmt is set for the fixed-length serial frames.
+typedef struct {
+    const char *name;
+    const char *label;
+    bool built;
+    int baud;
+    const char *format;    // data bits, parity, stop bits
+#if WAYBEAM_WITH_SBUS
+    const rx_frame_fmt_t *fmt;
+#endif
+} rc_proto_t;
+
+static const rc_proto_t rc_protos[] = {
+    [PROTO_CRSF] = { "crsf", "CRSF", true, UART_DEFAULT_BAUD, "8N1" },
+    [PROTO_MAVLINK] = { "mavlink", "MAVLink", WAYBEAM_WITH_MAVLINK, UART_DEFAULT_BAUD, "8N1" },
+#if WAYBEAM_WITH_SBUS
+    // SBUS is also inverted on the wire, which open_uart() cannot undo
+    [PROTO_SBUS] = { "sbus", "SBUS", true, 100000, "8E2", &sbus_fmt },
+    [PROTO_IBUS] = { "ibus", "IBUS", true, 115200, "8N1", &ibus_fmt },
+#endif
+};
+
+static int rc_proto_by_name(const char *name) {
+    for (size_t k = 0; k < sizeof(rc_protos) / sizeof(rc_protos[0]); k++) {
+        if (rc_protos[k].name && rc_protos[k].built && !strcmp(rc_protos[k].name, name)) return (int)k;
+    }
+    return -1;
+}
+
+// One batch from the UDP or UART stream in the --proto format. MAVLink
+// messages may set only some channels, and IBUS carries 14 (or 16) of
+// them; the others keep their last value.
+static void rc_stream_parse(const cfg_t *cfg, const bridge_t *b, stream_buf_t *sb, crsf_parse_result_t *res) {
+    memset(res, 0, sizeof(*res));
+    if (cfg->proto != PROTO_CRSF) memcpy(res->ch_us, b->last_ch_us, sizeof(res->ch_us));
+#if WAYBEAM_WITH_MAVLINK
+    if (cfg->proto == PROTO_MAVLINK) {
+        mavlink_stream_parse(sb, res, VERBOSE(cfg));
+        return;
+    }
+#endif
+#if WAYBEAM_WITH_SBUS
+    if (rc_protos[cfg->proto].fmt) {
+        fixed_stream_parse(rc_protos[cfg->proto].fmt, cfg->proto, sb, res, VERBOSE(cfg));
+        return;
+    }
+#endif
+    crsf_stream_parse(sb, res, VERBOSE(cfg));
+}
+
+static int open_udp_socket(int port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Queue sizing plus the per-datagram metadata the loop reads: SO_RXQ_OVFL
+// (cumulative overflow drops) always, RX timestamps only for --max-age-ms
+// and --echo. SO_RCVBUFFORCE lets root go past net.core.rmem_max.
+static void udp_tune_socket(int sock, const cfg_t *cfg) {
+    int one = 1;
+
+    if (cfg->rcvbuf > 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &cfg->rcvbuf, sizeof(cfg->rcvbuf)) != 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &cfg->rcvbuf, sizeof(cfg->rcvbuf)) != 0) {
+        perror("SO_RCVBUF");
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) != 0 && VERBOSE(cfg)) {
+        perror("SO_RXQ_OVFL");
+    }
+    if ((cfg->max_age_ms > 0 || cfg->echo) &&
+        setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0) {
+        perror("SO_TIMESTAMPNS");
+    }
+}
+
+// Picks up the drop counter and returns the datagram's queueing age in ms,
+// -1 without a timestamp. The kernel stamps with CLOCK_REALTIME; the stamp
+// goes to *rx_ts, left untouched without one.
+static int udp_rx_cmsg(const cfg_t *cfg, struct msghdr *msg, udp_stats_t *st, struct timespec *rx_ts) {
+    int age_ms = -1;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET) continue;
+        if (c->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+            if (drops != st->kernel_drops) {
+                if (VERBOSE(cfg)) LOGE(EV_UDP_OVFL, drops - st->kernel_drops, drops);
+                st->kernel_drops = drops;
+            }
+        } else if (c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec rx, now;
+            memcpy(&rx, CMSG_DATA(c), sizeof(rx));
+            *rx_ts = rx;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int64_t ms = (int64_t)(now.tv_sec - rx.tv_sec) * 1000 + (now.tv_nsec - rx.tv_nsec) / 1000000;
+            // A stepped wall clock must not turn into a huge or negative age
+            age_ms = ms < 0 ? 0 : (ms > INT_MAX ? INT_MAX : (int)ms);
+        }
+    }
+    return age_ms;
+}
+
+// Dissolve a connect()ed peer so any source is accepted again
+static int udp_disconnect(int sock) {
+    struct sockaddr sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_family = AF_UNSPEC;
+    return connect(sock, &sa, sizeof(sa));
+}
+
+// A connected UDP socket turns an ICMP port unreachable (the peer closed the
+// port an --echo reply went to) into a pending ECONNREFUSED. Reading SO_ERROR
+// clears it; true when that was the error behind the POLLERR.
+static bool udp_clear_refused(int sock) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0) return false;
+    return err == ECONNREFUSED;
+}
+
+static bool same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+#if WAYBEAM_WITH_ECHO
+enum {
+    ECHO_RC = 1 << 0,       // the probe's datagram carried an RC frame
+    ECHO_WRITTEN = 1 << 1,  // ... and it changed at least one output
+};
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+// Probe reply, an extended frame back to the probe's origin: dest, origin,
+// seq (be32), sender timestamp, RX and write-done (be64 each), flags.
+// RX and write-done are this host's CLOCK_REALTIME in ns, write-done 0 when
+// nothing was written. Never blocks: a full socket buffer drops the reply.
+static int echo_reply(int sock, const struct sockaddr_in *to, const crsf_parse_result_t *res,
+                      uint64_t rx_ns, uint64_t write_ns, uint8_t flags) {
+    uint8_t f[35];
+    f[0] = CRSF_ADDR_RADIO_TRANSMITTER;
+    f[1] = sizeof(f) - 2;
+    f[2] = CRSF_TYPE_LATENCY_PROBE;
+    f[3] = res->probe_origin;
+    f[4] = CRSF_ADDR_FLIGHT_CONTROLLER;
+    put_be(&f[5], res->probe_seq, 4);
+    put_be(&f[9], res->probe_tx, 8);
+    put_be(&f[17], rx_ns, 8);
+    put_be(&f[25], write_ns, 8);
+    f[33] = flags;
+    f[34] = crsf_crc8(&f[2], sizeof(f) - 3);
+    // A connected (peer-locked) socket already has the destination
+    ssize_t n = to ? sendto(sock, f, sizeof(f), MSG_DONTWAIT, (const struct sockaddr *)to, sizeof(*to))
+                   : send(sock, f, sizeof(f), MSG_DONTWAIT);
+    return n == (ssize_t)sizeof(f) ? 0 : -1;
+}
+
+typedef struct {
+    size_t probes;
+    size_t replies;
+    size_t send_errors;
+} echo_stats_t;
+
+static size_t bridge_writes(const bridge_t *b) {
+    size_t n = 0;
+    for (int idx = 0; idx < b->n_out; idx++) n += b->pwm[idx].writes;
+    return n;
+}
+
+// Runs right after the probe's datagram went through bridge_apply_rc(), whose
+// sysfs writes are synchronous: now is when the frame's last write returned.
+static void echo_answer(int sock, const struct sockaddr_in *to, const crsf_parse_result_t *res,
+                        const struct timespec *rx_ts, size_t writes_before, const bridge_t *b,
+                        echo_stats_t *st) {
+    struct timespec done;
+    clock_gettime(CLOCK_REALTIME, &done);
+    bool written = bridge_writes(b) != writes_before;
+    uint8_t flags = (res->got_rc ? ECHO_RC : 0) | (written ? ECHO_WRITTEN : 0);
+    st->probes++;
+    if (echo_reply(sock, to, res, timespec_ns(rx_ts), written ? timespec_ns(&done) : 0, flags) != 0) {
+        st->send_errors++;
+        return;
+    }
+    st->replies++;
+    PROBE(echo_reply, "seq=%u written=%d", (unsigned)res->probe_seq, written);
+}
+#endif
+
+#if WAYBEAM_WITH_BPF
+// Classic BPF socket filter, checked in softirq before the datagram is queued:
+// payload starts with the CRSF sync byte and has a sane frame length byte
+// (a MAVLink start byte with --proto mavlink, the sync byte with sbus/ibus),
+// has a plausible size, and (with --allow-src) comes from an allowed
+// address/port. Everything else is dropped without waking the control loop.
+// A UDP socket filter sees the skb at the UDP header; the IPv4 source is at
+// SKF_NET_OFF+12.
+#define UDP_HDR_LEN 8
+#define BPF_TO_DROP 0xFF        // jump placeholder, patched to the final "ret #0"
+
+static int udp_attach_filter(int sock, const cfg_t *cfg) {
+    struct sock_filter prog[9 + MAX_ALLOW_SRC * 5];
+    unsigned short n = 0;
+
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0);
+    prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, UDP_HDR_LEN + 4, 0, BPF_TO_DROP);
+    prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K,
+                                             UDP_HDR_LEN + UDP_FILTER_MAX_PAYLOAD, BPF_TO_DROP, 0);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP_HDR_LEN + 0);
+#if WAYBEAM_WITH_MAVLINK
+    if (cfg->proto == PROTO_MAVLINK) {
+        // A v2 or v1 start byte; any length byte is valid
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, MAV_STX_V2, 1, 0);
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, MAV_STX_V1, 0, BPF_TO_DROP);
+    } else
+#endif
+#if WAYBEAM_WITH_SBUS
+    if (rc_protos[cfg->proto].fmt) {
+        // The sync byte only, the frame check needs the whole frame
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, rc_protos[cfg->proto].fmt->sync,
+                                                 0, BPF_TO_DROP);
+    } else
+#endif
+    {
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, CRSF_ADDR_FLIGHT_CONTROLLER,
+                                                 0, BPF_TO_DROP);
+        // Same 2..62 frame length rule as crsf_stream_parse()
+        prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP_HDR_LEN + 1);
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 2, 0, BPF_TO_DROP);
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 62, BPF_TO_DROP, 0);
+    }
+    unsigned short checks_end = n;
+
+    if (cfg->allow_src_count == 0) {
+        prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFFU);
+    }
+    // One block per entry: a mismatch skips to the next block
+    for (int i = 0; i < cfg->allow_src_count; i++) {
+        uint32_t addr = cfg->allow_src[i].addr;
+        uint16_t port = cfg->allow_src[i].port;
+        if (addr) {
+            prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12);
+            prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, addr, 0, port ? 3 : 1);
+        }
+        if (port) {
+            prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0);
+            prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1);
+        }
+        prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFFU);
+    }
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+    for (unsigned short k = 0; k < checks_end; k++) {
+        if (prog[k].jt == BPF_TO_DROP) prog[k].jt = (uint8_t)(n - 1 - (k + 1));
+        if (prog[k].jf == BPF_TO_DROP) prog[k].jf = (uint8_t)(n - 1 - (k + 1));
+    }
+
+    struct sock_fprog fprog = { .len = n, .filter = prog };
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) != 0) {
+        perror("SO_ATTACH_FILTER");
+        return -1;
+    }
+    return n;
+}
+
+// "A.B.C.D", "A.B.C.D:PORT" or ":PORT"; 0.0.0.0 / missing port mean any
+static int parse_allow_src(const char *s, uint32_t *addr, uint16_t *port) {
+    char host[INET_ADDRSTRLEN] = "";
+    const char *colon = strrchr(s, ':');
+    size_t hlen = colon ? (size_t)(colon - s) : strlen(s);
+    int port_val = 0;
+
+    if (hlen >= sizeof(host)) return -1;
+    memcpy(host, s, hlen);
+    host[hlen] = '\0';
+    if (colon && (parse_int(colon + 1, &port_val) != 0 || port_val <= 0 || port_val > 65535)) {
+        return -1;
+    }
+
+    struct in_addr in = { .s_addr = 0 };
+    if (host[0] && inet_pton(AF_INET, host, &in) != 1) return -1;
+    if (!in.s_addr && !port_val) return -1; // would allow everything
+    *addr = ntohl(in.s_addr);
+    *port = (uint16_t)port_val;
+    return 0;
+}
+#endif
+
+#if WAYBEAM_WITH_UART
+// Raw 8N1 or 8E2 ("8E2" = even parity, two stop bits) at an arbitrary rate
+// (BOTHER), non-blocking. Also works on a pty, which ignores the speed, so
+// the kernel ldisc can be exercised against it. Parity errors are not
+// checked (no INPCK): the frame checks reject damaged bytes. The line is
+// never inverted here; SBUS needs an inverter or an RX-invert pin setting.
+static int open_uart(const char *dev, int baud, const char *format) {
+    int fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        perror("open uart");
+        return -1;
+    }
+
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        perror("uart TCGETS2");
+        close(fd);
+        return -1;
+    }
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+    if (format[1] == 'E') tio.c_cflag |= PARENB;
+    if (format[2] == '2') tio.c_cflag |= CSTOPB;
+    tio.c_ispeed = (speed_t)baud;
+    tio.c_ospeed = (speed_t)baud;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        perror("uart TCSETS2");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+typedef struct {
+    size_t bytes;
+    size_t frames;         // passed the frame check
+    size_t rc;
+    size_t failsafe;       // SBUS failsafe flag
+    size_t lost;           // SBUS frame-lost flag
+    bool warned;
+} uart_stats_t;
+
+// A wrong rate or format, or an inverted line, reads as a steady stream of
+// bytes with no valid frame in it. Warned once, with the driver's line
+// error counters when it keeps them (real UARTs do, ptys don't).
+static void uart_warn_nosync(int fd, const cfg_t *cfg, size_t bytes) {
+    struct serial_icounter_struct ic;
+
+    fprintf(stderr, "WARN: %zu bytes from %s without a valid %s frame: check --uart-baud %d and the %s format%s\n",
+            bytes, cfg->uart_dev, rc_protos[cfg->proto].label, cfg->uart_baud, rc_protos[cfg->proto].format,
+            cfg->proto == PROTO_SBUS ? ", and that the inverted SBUS signal goes through an inverter" : "");
+    if (ioctl(fd, TIOCGICOUNT, &ic) == 0) {
+        fprintf(stderr, "WARN: %s line errors: framing=%d parity=%d overrun=%d\n",
+                cfg->uart_dev, ic.frame, ic.parity, ic.overrun + ic.buf_overrun);
+    }
+}
+#endif
+
+#if WAYBEAM_WITH_SSE
+// ---------------------------------------------------------------------------
+// SSE server (adapted from joystick2crsf)
+// ---------------------------------------------------------------------------
+
+static int set_nonblock(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int sse_send_all(int fd, const char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+        if (n > 0) { off += (size_t)n; continue; }
+        if (n == 0) return -1;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return (off == 0) ? 1 : -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static int open_sse_listener(const char *host, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { perror("sse socket"); return -1; }
+
+    int one = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+        fprintf(stderr, "SSE: invalid bind address '%s'\n", host);
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        perror("sse bind");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, 4) != 0) {
+        perror("sse listen");
+        close(fd);
+        return -1;
+    }
+    set_nonblock(fd);
+    return fd;
+}
+
+static void sse_pending_reset(sse_pending_client_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->fd = -1;
+}
+
+static void sse_pending_close(sse_pending_client_t *p) {
+    if (p->fd >= 0) close(p->fd);
+    sse_pending_reset(p);
+}
+
+static int sse_request_complete(const char *req) {
+    return strstr(req, "\r\n\r\n") || strstr(req, "\n\n");
+}
+
+static void sse_prepare_response(sse_pending_client_t *p, const char *path) {
+    static const char *headers =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: keep-alive\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "\r\n"
+        ": waybeam-pwm\n\n";
+    static const char *reject =
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+
+    p->accepted = 0;
+
+    char *line_end = strpbrk(p->request, "\r\n");
+    if (line_end) *line_end = '\0';
+
+    if (strncmp(p->request, "GET ", 4) != 0) {
+        snprintf(p->response, sizeof(p->response), "%s", reject);
+        p->response_len = strlen(p->response);
+        return;
+    }
 
-    struct sockaddr_in sa;
+    char *uri = p->request + 4;
+    char *space = strchr(uri, ' ');
+    if (!space) {
+        snprintf(p->response, sizeof(p->response), "%s", reject);
+        p->response_len = strlen(p->response);
+        return;
+    }
+    *space = '\0';
+
+    if (path && path[0]) {
+        size_t plen = strlen(path);
+        if (strncmp(uri, path, plen) != 0 ||
+            (uri[plen] != '\0' && uri[plen] != '?' && uri[plen] != '#')) {
+            fprintf(stderr, "SSE: request for unexpected path '%s'\n", uri);
+            snprintf(p->response, sizeof(p->response), "%s", reject);
+            p->response_len = strlen(p->response);
+            return;
+        }
+    }
+
+    snprintf(p->response, sizeof(p->response), "%s", headers);
+    p->response_len = strlen(p->response);
+    p->accepted = 1;
+}
+
+static int sse_accept_pending(int listen_fd, sse_pending_client_t *pending, uint64_t now_ms) {
+    if (listen_fd < 0) return 0;
+
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int cfd = accept(listen_fd, (struct sockaddr *)&addr, &addrlen);
+    if (cfd < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        perror("sse accept");
+        return -1;
+    }
+
+    if (set_nonblock(cfd) < 0) { close(cfd); return 0; }
+
+    if (pending->fd >= 0) sse_pending_close(pending);
+
+    pending->fd = cfd;
+    pending->deadline_ms = now_ms + SSE_HANDSHAKE_TIMEOUT_MS;
+    pending->request_used = 0;
+    pending->response_len = 0;
+    pending->response_off = 0;
+    pending->accepted = 0;
+    return 1;
+}
+
+// Returns 1 when a new SSE client was promoted, 2 when the request is a
+// POST/OPTIONS for http_adopt() (http only) and the caller owns pending
+static int sse_service_pending(sse_pending_client_t *pending, int *client_fd,
+                               const char *path, bool http, uint64_t now_ms) {
+    if (pending->fd < 0) return 0;
+
+    // Receive HTTP request
+    if (pending->response_len == 0) {
+        while (pending->request_used < sizeof(pending->request) - 1U) {
+            ssize_t n = recv(pending->fd,
+                             pending->request + pending->request_used,
+                             (sizeof(pending->request) - 1U) - pending->request_used, 0);
+            if (n > 0) {
+                pending->request_used += (size_t)n;
+                pending->request[pending->request_used] = '\0';
+                if (sse_request_complete(pending->request)) {
+                    if (http && (!strncmp(pending->request, "POST ", 5) ||
+                                 !strncmp(pending->request, "OPTIONS ", 8))) {
+                        return 2;
+                    }
+                    sse_prepare_response(pending, path);
+                    break;
+                }
+                continue;
+            }
+            if (n == 0) { sse_pending_close(pending); return 0; }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            sse_pending_close(pending); return 0;
+        }
+
+        if (pending->response_len == 0 &&
+            pending->request_used >= sizeof(pending->request) - 1U) {
+            sse_pending_close(pending);
+            return 0;
+        }
+    }
+
+    if (pending->response_len == 0) {
+        if (now_ms >= pending->deadline_ms) {
+            LOGE(EV_SSE_TIMEOUT, 0);
+            sse_pending_close(pending);
+        }
+        return 0;
+    }
+
+    // Send HTTP response
+    while (pending->response_off < pending->response_len) {
+        ssize_t n = send(pending->fd,
+                         pending->response + pending->response_off,
+                         pending->response_len - pending->response_off,
+                         MSG_NOSIGNAL);
+        if (n > 0) { pending->response_off += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (now_ms >= pending->deadline_ms) {
+                LOGE(EV_SSE_TIMEOUT, 0);
+                sse_pending_close(pending);
+            }
+            return 0;
+        }
+        sse_pending_close(pending); return 0;
+    }
+
+    if (!pending->accepted) { sse_pending_close(pending); return 0; }
+
+    // Promote to active client
+    if (*client_fd >= 0) close(*client_fd);
+    *client_fd = pending->fd;
+    pending->fd = -1;
+    sse_pending_reset(pending);
+    LOGE(EV_SSE_CONNECTED, 0);
+    return 1;
+}
+
+static int sse_send_channels(int fd, const int ch_us[16], bool link_active,
+                             bool failsafe, size_t rc_frames, const udp_stats_t *udp,
+                             const linkq_t *lq, const pwm_out_t *outs, int n_outs) {
+    if (fd < 0) return 0;
+
+    // Convert microseconds back to CRSF ticks for waybeam_hub compatibility
+    int ticks[16];
+    for (int i = 0; i < 16; i++)
+        ticks[i] = ((ch_us[i] - 1500) * 8) / 5 + 992;
+
+    char buf[768 + MAX_OUTPUTS * 112];
+    int off = snprintf(buf, sizeof(buf),
+        "event: serial\ndata: {\"stream\":\"serial\",\"channels\":[");
+    if (off < 0 || off >= (int)sizeof(buf)) return -1;
+
+    for (int i = 0; i < 16; i++) {
+        off += snprintf(buf + off, sizeof(buf) - (size_t)off,
+                        i ? ",%d" : "%d", ticks[i]);
+        if (off < 0 || off >= (int)sizeof(buf)) return -1;
+    }
+
+    off += snprintf(buf + off, sizeof(buf) - (size_t)off,
+        "],\"link\":%s,\"rc_frames\":%zu,\"failsafe\":%s,"
+        "\"udp\":{\"datagrams\":%zu,\"kernel_drops\":%u,\"stale\":%zu},"
+        "\"linkq\":{\"interval_us\":%u,\"jitter_us\":%u,\"p50_us\":%u,\"p95_us\":%u,"
+        "\"loss_pct\":%u.%u,\"hold_ms\":%d,\"center_ms\":%d},\"outputs\":[",
+        link_active ? "true" : "false", rc_frames,
+        failsafe ? "true" : "false",
+        udp->datagrams, (unsigned)udp->kernel_drops, udp->stale,
+        (unsigned)(lq->interval_x16 / 16), (unsigned)(lq->jitter_x16 / 16),
+        (unsigned)lq->p50_us, (unsigned)lq->p95_us,
+        (unsigned)(lq->loss_permille / 10), (unsigned)(lq->loss_permille % 10),
+        lq->hold_ms, lq->center_ms);
+    if (off < 0 || off >= (int)sizeof(buf)) return -1;
+
+    for (int i = 0; i < n_outs; i++) {
+        const pwm_out_t *o = &outs[i];
+        off += snprintf(buf + off, sizeof(buf) - (size_t)off,
+                        "%s{\"pwm\":%d,\"chip\":%d,\"hw\":%d,\"us\":%d,\"writes\":%zu,"
+                        "\"suppressed\":%zu,\"predicted\":%zu}",
+                        i ? "," : "", i, o->chip, o->hw, o->available ? o->last_us : -1,
+                        o->writes, o->suppressed, o->predicted);
+        if (off < 0 || off >= (int)sizeof(buf)) return -1;
+    }
+
+    off += snprintf(buf + off, sizeof(buf) - (size_t)off, "]}\n\n");
+    if (off < 0 || off >= (int)sizeof(buf)) return -1;
+
+    return sse_send_all(fd, buf, (size_t)off);
+}
+#endif
+
+#if WAYBEAM_WITH_HTTP
+// ---------------------------------------------------------------------------
+// POST /outputs (--http-outputs)
+//
+// Keep-alive HTTP/1.1 on the SSE listener, for web UIs that drive outputs
+// without a CRSF encoder. The body is "CH=US" pairs joined by '&' or ','
+// (a form body), e.g. "1=1600&2=1400"; US 0 releases the channel. Values
+// become channel overrides at --http-prio with a --http-ttl-ms lifetime,
+// the slots --inject uses, committed as soon as the body is complete.
+// Requests are parsed byte by byte into fixed per-connection state: no
+// allocation and no body buffer.
+//
+// A POST must carry X-Requested-With. A browser can only add it to a
+// cross-origin request after a CORS preflight, and the preflight only
+// succeeds for --http-origin, so other pages cannot forge a form POST.
+// ---------------------------------------------------------------------------
+
+enum { HTTP_LINE, HTTP_HEADER, HTTP_BODY };
+
+typedef struct {
+    int state;              // HTTP_*
+    int status;             // error to answer once the request is in, 0 = none
+    bool post;              // else OPTIONS (CORS preflight)
+    bool close;             // Connection: close or HTTP/1.0
+    bool xrw;               // X-Requested-With seen
+    char line[64];          // request or header line, truncated
+    size_t line_len;
+    int content_len;        // -1 = no Content-Length
+    int body_left;
+    int n;                  // body entries so far
+    int ch[16];
+    int us[16];
+    int key;                // entry being parsed
+    int val;
+    int digits;             // in the current key or value
+    bool in_val;
+} http_client_t;
+
+typedef struct {
+    size_t requests;
+    size_t applied;
+    size_t refused;         // slot held at a higher priority
+    size_t invalid;         // answered with an error
+} http_stats_t;
+
+static void http_reset(http_client_t *h) {
+    memset(h, 0, sizeof(*h));
+    h->content_len = -1;
+}
+
+static const char *http_reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    default: return "Service Unavailable";
+    }
+}
+
+// The whole response in one non-blocking send; a client that cannot take a
+// few hundred bytes is dropped. origin is --http-origin, "" = no CORS header.
+static int http_reply(int fd, int status, bool close, const char *origin, const char *extra,
+                      const char *body) {
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+                       "HTTP/1.1 %d %s\r\n"
+                       "%s%s%s"
+                       "%s"
+                       "Content-Length: %zu\r\n"
+                       "Connection: %s\r\n"
+                       "\r\n"
+                       "%s",
+                       status, http_reason(status),
+                       origin[0] ? "Access-Control-Allow-Origin: " : "", origin, origin[0] ? "\r\n" : "",
+                       extra, strlen(body), close ? "close" : "keep-alive", body);
+    if (len < 0 || len >= (int)sizeof(buf)) return -1;
+    return send(fd, buf, (size_t)len, MSG_DONTWAIT | MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+// "METHOD /outputs[?query] HTTP/1.x"
+static void http_request_line(http_client_t *h) {
+    char *path = strchr(h->line, ' ');
+    char *ver = path ? strchr(path + 1, ' ') : NULL;
+    if (!ver) {
+        h->status = 400;
+        return;
+    }
+    *path++ = '\0';
+    *ver++ = '\0';
+    if (strcspn(path, "?") != 8 || strncmp(path, "/outputs", 8) != 0) {
+        h->status = 404;
+        return;
+    }
+    h->post = !strcmp(h->line, "POST");
+    if (!h->post && strcmp(h->line, "OPTIONS") != 0) h->status = 405;
+    h->close = strcmp(ver, "HTTP/1.1") != 0;
+}
+
+// Only the headers that frame the request matter
+static void http_header(http_client_t *h) {
+    char *v = strchr(h->line, ':');
+    if (!v) return;
+    *v++ = '\0';
+    v += strspn(v, " \t");
+    if (!strcasecmp(h->line, "Content-Length")) {
+        if (parse_int(v, &h->content_len) != 0 || h->content_len < 0) h->status = 400;
+    } else if (!strcasecmp(h->line, "Transfer-Encoding")) {
+        h->status = 411;    // no chunked bodies
+    } else if (!strcasecmp(h->line, "Connection")) {
+        if (!strcasecmp(v, "close")) h->close = true;
+        if (!strcasecmp(v, "keep-alive")) h->close = false;
+    } else if (!strcasecmp(h->line, "X-Requested-With")) {
+        h->xrw = true;
+    }
+}
+
+static void http_body_char(http_client_t *h, uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        if (++h->digits > 5) {
+            h->status = 400;
+            return;
+        }
+        if (h->in_val) {
+            h->val = h->val * 10 + (c - '0');
+        } else {
+            h->key = h->key * 10 + (c - '0');
+        }
+    } else if (c == '=' && !h->in_val && h->digits) {
+        h->in_val = true;
+        h->digits = 0;
+    } else if (c == '&' || c == ',' || c == '\r' || c == '\n') {
+        if (!h->in_val && !h->digits) return;   // empty entry
+        if (!h->in_val || !h->digits || h->n >= 16) {
+            h->status = 400;
+            return;
+        }
+        h->ch[h->n] = h->key;
+        h->us[h->n++] = h->val;
+        h->key = h->val = h->digits = 0;
+        h->in_val = false;
+    } else {
+        h->status = 400;
+    }
+}
+
+// Answers the request in h and readies it for the next one on the connection
+static int http_finish(int fd, http_client_t *h, bridge_t *b, http_stats_t *st, uint64_t now, bool *changed) {
+    const cfg_t *cfg = b->cfg;
+    unsigned applied = 0, refused = 0;
+    int rc;
+
+    st->requests++;
+    if (h->post && !h->status) {
+        http_body_char(h, '&');     // the last entry has no separator
+        for (int i = 0; i < h->n && !h->status; i++) {
+            if (h->ch[i] < 1 || h->ch[i] > 16 ||
+                (h->us[i] && (h->us[i] < cfg->min_us || h->us[i] > cfg->max_us))) {
+                h->status = 400;
+            }
+        }
+    }
+    if (h->status) {
+        st->invalid++;
+        rc = http_reply(fd, h->status, h->close, cfg->http_origin, "", "");
+    } else if (!h->post) {
+        rc = http_reply(fd, 200, h->close, cfg->http_origin,
+                        "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
+                        "Access-Control-Allow-Headers: Content-Type, X-Requested-With\r\n", "");
+    } else {
+        // All or nothing: a 400 above applied no entry
+        for (int i = 0; i < h->n; i++) {
+            if (inject_set(&b->ovr[h->ch[i] - 1], h->us[i], cfg->http_prio, (uint32_t)cfg->http_ttl_ms, now)) {
+                applied++;
+            } else {
+                refused++;
+            }
+        }
+        st->applied += applied;
+        st->refused += refused;
+        *changed = *changed || applied;
+        char body[48];
+        snprintf(body, sizeof(body), "{\"applied\":%u,\"refused\":%u}", applied, refused);
+        rc = http_reply(fd, 200, h->close, cfg->http_origin, "Content-Type: application/json\r\n", body);
+    }
+    if (VERBOSE(cfg) > 1) {
+        LOGE(EV_HTTP_OUTPUTS, (uint32_t)h->n, applied, refused, (uint32_t)(h->status ? h->status : 200));
+    }
+
+    bool close = h->close;
+    http_reset(h);
+    return rc < 0 || close ? -1 : 0;
+}
+
+// End of the header block: framing errors close the connection, since the
+// rest of the stream cannot be trusted
+static int http_headers_done(int fd, http_client_t *h, bridge_t *b, http_stats_t *st, uint64_t now, bool *changed) {
+    if (!h->status && h->content_len > HTTP_MAX_BODY) h->status = 413;
+    if (!h->status && h->post && h->content_len < 0) h->status = 411;
+    if (!h->status && h->post && !h->xrw) h->status = 403;
+    if (h->status) {
+        h->close = true;
+        return http_finish(fd, h, b, st, now, changed);
+    }
+    h->body_left = h->content_len > 0 ? h->content_len : 0;
+    if (!h->body_left) return http_finish(fd, h, b, st, now, changed);
+    h->state = HTTP_BODY;
+    return 0;
+}
+
+// Any split of the byte stream gives the same result; pipelined requests
+// are answered in order. Returns -1 when the connection must be closed.
+static int http_feed(int fd, http_client_t *h, const uint8_t *p, size_t n,
+                     bridge_t *b, http_stats_t *st, uint64_t now, bool *changed) {
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = p[i];
+        if (h->state == HTTP_BODY) {
+            if (h->post && !h->status) http_body_char(h, c);
+            if (--h->body_left == 0 && http_finish(fd, h, b, st, now, changed) < 0) return -1;
+            continue;
+        }
+        if (c != '\n') {
+            if (c != '\r' && h->line_len < sizeof(h->line) - 1) h->line[h->line_len++] = (char)c;
+            continue;
+        }
+        h->line[h->line_len] = '\0';
+        h->line_len = 0;
+        if (h->state == HTTP_LINE) {
+            if (!h->line[0]) continue;  // stray CRLF between requests
+            http_request_line(h);
+            h->state = HTTP_HEADER;
+        } else if (h->line[0]) {
+            http_header(h);
+        } else if (http_headers_done(fd, h, b, st, now, changed) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int http_service(int fd, http_client_t *h, bridge_t *b, http_stats_t *st, uint64_t now, bool *changed) {
+    uint8_t buf[512];
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0) return http_feed(fd, h, buf, (size_t)n, b, st, now, changed);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    return -1;
+}
+
+// Moves a POST/OPTIONS connection from the SSE handshake slot to a free
+// keep-alive slot, and parses what it already sent
+static void http_adopt(sse_pending_client_t *pending, struct pollfd *slots, http_client_t *clients,
+                       bridge_t *b, http_stats_t *st, uint64_t now, bool *changed) {
+    const cfg_t *cfg = b->cfg;
+    int fd = pending->fd;
+    for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        if (slots[i].fd >= 0) continue;
+        // Pipelined replies must not wait behind an unacked earlier one
+        int one = 1;
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        http_reset(&clients[i]);
+        if (http_feed(fd, &clients[i], (const uint8_t *)pending->request, pending->request_used,
+                      b, st, now, changed) < 0) {
+            close(fd);
+        } else {
+            slots[i] = (struct pollfd){ .fd = fd, .events = POLLIN, .revents = 0 };
+            if (VERBOSE(cfg)) LOGE(EV_HTTP_CONNECTED, (uint32_t)i);
+        }
+        sse_pending_reset(pending);
+        return;
+    }
+    if (VERBOSE(cfg)) LOGE(EV_HTTP_FULL, 0);
+    (void)http_reply(fd, 503, true, cfg->http_origin, "", "");
+    close(fd);
+    sse_pending_reset(pending);
+}
+
+// --http-link: a POST that changed a slot is also an RC update, so a web UI
+// alone keeps the outputs out of failsafe, and stopping it lets them fall in
+static void http_commit(bridge_t *b, uint64_t now) {
+    if (!b->cfg->http_link) {
+        bridge_remap(b, now, false);
+        return;
+    }
+    crsf_parse_result_t res;
+    memset(&res, 0, sizeof(res));
+    memcpy(res.ch_us, b->last_ch_us, sizeof(res.ch_us));
+    res.got_rc = true;
+    res.rc_frames = 1;
+    bridge_apply_rc(b, &res, now);
+}
+#endif
+
+#if WAYBEAM_WITH_CTL || WAYBEAM_WITH_INJECT
+// Bound, non-blocking local socket for --ctl/--inject, owner and group only:
+// these sockets move servos. A socket file left behind by a killed instance
+// is replaced unless something still answers on it; nothing else is unlinked.
+static int open_unix_socket(const char *path, int type, const char *what) {
+    struct sockaddr_un sa;
     memset(&sa, 0, sizeof(sa));
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons((uint16_t)port);
-    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
-        fprintf(stderr, "SSE: invalid bind address '%s'\n", host);
+    sa.sun_family = AF_UNIX;
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s socket: %s\n", what, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            fprintf(stderr, "%s: %s is in use by another instance\n", what, path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        fprintf(stderr, "%s bind %s: %s\n", what, path, strerror(errno));
         close(fd);
         return -1;
     }
+    (void)chmod(path, 0660);
+    return fd;
+}
+#endif
+
+#if WAYBEAM_WITH_CTL
+// ---------------------------------------------------------------------------
+// Control socket (--ctl PATH)
+//
+// SOCK_SEQPACKET keeps message boundaries, so there is no framing to parse:
+// one request per message, one reply per request. Fixed-size structs in host
+// byte order (both ends run on this SoC). A readable client gets one request
+// serviced per loop pass and every request is O(1), so a chatty client
+// cannot starve the RC path.
+// ---------------------------------------------------------------------------
+
+#define CTL_VERSION 2           // 2: MAX_OUTPUTS outputs in stats and snapshot
+
+enum {
+    CTL_OP_GET_STATS = 1,       // -> ctl_stats_t
+    CTL_OP_GET_SNAPSHOT,        // -> ctl_snapshot_t
+    CTL_OP_SET_MAP,             // ctl_set_map_t ->
+    CTL_OP_SET_LIMITS,          // ctl_set_limits_t ->
+    CTL_OP_FAILSAFE,            // ctl_failsafe_t ->
+    CTL_OP_OVERRIDE,            // ctl_override_t ->
+};
+
+typedef struct {
+    uint8_t version;            // CTL_VERSION
+    uint8_t op;                 // CTL_OP_*, echoed
+    uint16_t seq;               // echoed
+    int32_t status;             // reply: 0 or -errno
+} ctl_hdr_t;
+
+typedef struct {
+    uint64_t rc_frames;
+    uint64_t udp_datagrams;
+    uint64_t udp_stale;
+    uint32_t udp_kernel_drops;
+    uint32_t interval_us;       // link estimator, see linkq_t
+    uint32_t jitter_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t loss_permille;
+    int32_t hold_ms;            // thresholds in effect
+    int32_t center_ms;
+    uint8_t link_active;
+    uint8_t failsafe;
+    uint8_t forced_failsafe;
+    uint8_t out_count;          // entries of out[] in use
+    struct {
+        uint32_t writes;
+        uint32_t suppressed;
+        uint32_t unchanged;
+        uint32_t predicted;
+        uint32_t errors;
+    } out[MAX_OUTPUTS];
+} ctl_stats_t;
+
+typedef struct {
+    int16_t ch_us[16];          // last received frame, before overrides
+    int16_t override_us[16];    // live overrides (--ctl or --inject), 0 = none
+    int16_t out_us[MAX_OUTPUTS]; // last written value, -1 = output not available
+    uint8_t out_ch[MAX_OUTPUTS]; // mapped CRSF channel, 0 = none
+    int16_t min_us;
+    int16_t max_us;
+    int16_t center_us;
+    uint16_t out_count;         // entries of out_us[]/out_ch[] in use
+    int16_t offset_us[16];      // live additive offsets (--inject), 0 = none
+} ctl_snapshot_t;
+
+typedef struct {
+    uint8_t pwm;                // output index, must have been enabled at startup
+    uint8_t crsf_ch;            // 1..16, 0 = stop driving the output (it holds)
+} ctl_set_map_t;
+
+typedef struct {
+    int16_t min_us;             // same bounds as --min-us/--max-us; center and
+    int16_t max_us;             // failsafe values must stay inside
+} ctl_set_limits_t;
 
-    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
-        perror("sse bind");
-        close(fd);
-        return -1;
-    }
-    if (listen(fd, 4) != 0) {
-        perror("sse listen");
+typedef struct {
+    uint8_t engage;             // 1 = enter and hold failsafe, 0 = release
+} ctl_failsafe_t;
+
+typedef struct {
+    uint8_t crsf_ch;            // 1..16
+    uint8_t reserved;
+    int16_t us;                 // within min..max, 0 = release
+    uint32_t ttl_ms;            // 0 = until released
+} ctl_override_t;
+
+typedef struct {
+    ctl_hdr_t hdr;
+    union {
+        ctl_stats_t stats;
+        ctl_snapshot_t snap;
+    } u;
+} ctl_reply_t;
+
+static int open_ctl_listener(const char *path) {
+    int fd = open_unix_socket(path, SOCK_SEQPACKET, "ctl");
+    if (fd < 0) return -1;
+    if (listen(fd, CTL_MAX_CLIENTS) != 0) {
+        perror("ctl listen");
         close(fd);
+        unlink(path);
         return -1;
     }
-    set_nonblock(fd);
     return fd;
 }
 
-static void sse_pending_reset(sse_pending_client_t *p) {
-    memset(p, 0, sizeof(*p));
-    p->fd = -1;
+static void ctl_accept(int listen_fd, struct pollfd *slots, const cfg_t *cfg) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        if (slots[i].fd >= 0) continue;
+        slots[i] = (struct pollfd){ .fd = fd, .events = POLLIN, .revents = 0 };
+        if (VERBOSE(cfg)) LOGE(EV_CTL_CONNECTED, (uint32_t)i);
+        return;
+    }
+    if (VERBOSE(cfg)) LOGE(EV_CTL_FULL, 0);
+    close(fd);
 }
 
-static void sse_pending_close(sse_pending_client_t *p) {
-    if (p->fd >= 0) close(p->fd);
-    sse_pending_reset(p);
+static bool ctl_arg(void *dst, size_t size, const uint8_t *arg, size_t arg_len) {
+    if (arg_len != size) return false;
+    memcpy(dst, arg, size);
+    return true;
 }
 
-static int sse_request_complete(const char *req) {
-    return strstr(req, "\r\n\r\n") || strstr(req, "\n\n");
+// Executes one request; returns the reply payload length, errors go to status
+static size_t ctl_handle(cfg_t *cfg, bridge_t *b, const udp_stats_t *udp, uint8_t op,
+                         const uint8_t *arg, size_t arg_len, ctl_reply_t *rep, uint64_t now) {
+    int err = 0;
+    size_t len = 0;
+    int la = 0, lb = 0; // logged arguments
+    (void)la;
+    (void)lb;
+
+    switch (op) {
+    case CTL_OP_GET_STATS: {
+        if (arg_len) { err = EINVAL; break; }
+        ctl_stats_t *st = &rep->u.stats;
+        st->rc_frames = b->total_rc_frames;
+        st->udp_datagrams = udp->datagrams;
+        st->udp_stale = udp->stale;
+        st->udp_kernel_drops = udp->kernel_drops;
+        st->interval_us = b->lq.interval_x16 / 16;
+        st->jitter_us = b->lq.jitter_x16 / 16;
+        st->p50_us = b->lq.p50_us;
+        st->p95_us = b->lq.p95_us;
+        st->loss_permille = b->lq.loss_permille;
+        st->hold_ms = b->lq.hold_ms;
+        st->center_ms = b->lq.center_ms;
+        st->link_active = b->link_active;
+        st->failsafe = b->centered;
+        st->forced_failsafe = b->forced_failsafe;
+        st->out_count = (uint8_t)b->n_out;
+        for (int i = 0; i < b->n_out; i++) {
+            st->out[i].writes = (uint32_t)b->pwm[i].writes;
+            st->out[i].suppressed = (uint32_t)b->pwm[i].suppressed;
+            st->out[i].unchanged = (uint32_t)b->pwm[i].unchanged;
+            st->out[i].predicted = (uint32_t)b->pwm[i].predicted;
+            st->out[i].errors = (uint32_t)b->pwm[i].write_errors;
+        }
+        len = sizeof(*st);
+        break;
+    }
+    case CTL_OP_GET_SNAPSHOT: {
+        if (arg_len) { err = EINVAL; break; }
+        ctl_snapshot_t *sn = &rep->u.snap;
+        for (int i = 0; i < 16; i++) {
+            sn->ch_us[i] = (int16_t)b->last_ch_us[i];
+            sn->override_us[i] = inject_live(&b->ovr[i], now) ? (int16_t)b->ovr[i].us : 0;
+            sn->offset_us[i] = inject_live(&b->add[i], now) ? (int16_t)b->add[i].us : 0;
+        }
+        for (int i = 0; i < b->n_out; i++) {
+            sn->out_us[i] = b->pwm[i].available ? (int16_t)b->pwm[i].last_us : -1;
+            sn->out_ch[i] = (uint8_t)cfg->out_ch[i];
+        }
+        sn->out_count = (uint16_t)b->n_out;
+        sn->min_us = (int16_t)cfg->min_us;
+        sn->max_us = (int16_t)cfg->max_us;
+        sn->center_us = (int16_t)cfg->center_us;
+        len = sizeof(*sn);
+        break;
+    }
+    case CTL_OP_SET_MAP: {
+        ctl_set_map_t m;
+        if (!ctl_arg(&m, sizeof(m), arg, arg_len) || m.pwm >= b->n_out || m.crsf_ch > 16) {
+            err = EINVAL;
+            break;
+        }
+        la = m.pwm;
+        lb = m.crsf_ch;
+        // Outputs are exported and muxed at startup only
+        if (!b->pwm[m.pwm].available) { err = ENODEV; break; }
+        cfg->out_ch[m.pwm] = m.crsf_ch;
+        bridge_remap(b, now, true);
+        break;
+    }
+    case CTL_OP_SET_LIMITS: {
+        ctl_set_limits_t l;
+        if (!ctl_arg(&l, sizeof(l), arg, arg_len)) { err = EINVAL; break; }
+        la = l.min_us;
+        lb = l.max_us;
+        if (l.min_us < 500 || l.max_us > 2500 ||
+            cfg->center_us < l.min_us || cfg->center_us > l.max_us) {
+            err = ERANGE;
+            break;
+        }
+        for (int i = 0; i < b->n_out; i++) {
+            const pwm_out_t *o = &b->pwm[i];
+            if (o->available && !o->failsafe_hold &&
+                (o->failsafe_us < l.min_us || o->failsafe_us > l.max_us)) {
+                err = ERANGE;
+            }
+        }
+        if (err) break;
+        cfg->min_us = l.min_us;
+        cfg->max_us = l.max_us;
+        bridge_remap(b, now, true);
+        break;
+    }
+    case CTL_OP_FAILSAFE: {
+        ctl_failsafe_t f;
+        if (!ctl_arg(&f, sizeof(f), arg, arg_len) || f.engage > 1) { err = EINVAL; break; }
+        la = f.engage;
+        if (f.engage && !b->forced_failsafe && !b->centered) {
+            PROBE(failsafe_enter, "source=ctl pwm=%d age_ms=%llu", -1,
+                  (unsigned long long)(now - b->last_valid_ms));
+            bridge_failsafe_begin(b, now);
+            b->centered = true;
+        }
+        b->forced_failsafe = f.engage;
+        break;
+    }
+    case CTL_OP_OVERRIDE: {
+        ctl_override_t o;
+        if (!ctl_arg(&o, sizeof(o), arg, arg_len) || o.crsf_ch < 1 || o.crsf_ch > 16) {
+            err = EINVAL;
+            break;
+        }
+        la = o.crsf_ch;
+        lb = o.us;
+        if (o.us && (o.us < cfg->min_us || o.us > cfg->max_us)) { err = ERANGE; break; }
+        // Top priority: a supervisor always beats the injectors
+        (void)inject_set(&b->ovr[o.crsf_ch - 1], o.us, INJECT_PRIO_CTL, o.ttl_ms, now);
+        bridge_remap(b, now, true);
+        break;
+    }
+    default:
+        err = EOPNOTSUPP;
+        break;
+    }
+
+    // Queries are polled, so they only show at -vv
+    if (VERBOSE(cfg) > (op == CTL_OP_GET_STATS || op == CTL_OP_GET_SNAPSHOT ? 1 : 0)) {
+        LOGE(EV_CTL_REQ, (uint32_t)op, (uint32_t)la, (uint32_t)lb, (uint32_t)err);
+    }
+    rep->hdr.status = -err;
+    return err ? 0 : len;
 }
 
-static void sse_prepare_response(sse_pending_client_t *p, const char *path) {
-    static const char *headers =
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/event-stream\r\n"
-        "Cache-Control: no-cache\r\n"
-        "Connection: keep-alive\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "X-Accel-Buffering: no\r\n"
-        "\r\n"
-        ": waybeam-pwm\n\n";
-    static const char *reject =
-        "HTTP/1.1 404 Not Found\r\n"
-        "Content-Length: 0\r\n"
-        "Connection: close\r\n\r\n";
+// One request per call keeps the work per client per loop pass bounded.
+// Returns -1 when the client is gone.
+static int ctl_service(int fd, cfg_t *cfg, bridge_t *b, const udp_stats_t *udp, uint64_t now) {
+    union {
+        ctl_hdr_t hdr;
+        uint8_t buf[CTL_MSG_MAX];
+    } req;
+    // MSG_TRUNC: the real length, so oversized requests are refused, not cut
+    ssize_t n = recv(fd, req.buf, sizeof(req.buf), MSG_DONTWAIT | MSG_TRUNC);
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
 
-    p->accepted = 0;
+    ctl_reply_t rep;
+    size_t len = 0;
+    memset(&rep, 0, sizeof(rep));
+    if ((size_t)n < sizeof(req.hdr)) {
+        rep.hdr.status = -EINVAL;
+    } else {
+        rep.hdr.op = req.hdr.op;
+        rep.hdr.seq = req.hdr.seq;
+        if (req.hdr.version != CTL_VERSION) {
+            rep.hdr.status = -EPROTONOSUPPORT;
+        } else if ((size_t)n > sizeof(req.buf)) {
+            rep.hdr.status = -EMSGSIZE;
+        } else {
+            len = ctl_handle(cfg, b, udp, req.hdr.op, req.buf + sizeof(req.hdr),
+                             (size_t)n - sizeof(req.hdr), &rep, now);
+        }
+    }
+    rep.hdr.version = CTL_VERSION;
 
-    char *line_end = strpbrk(p->request, "\r\n");
-    if (line_end) *line_end = '\0';
+    // A client that does not read its replies loses them, it never blocks us
+    if (send(fd, &rep, sizeof(rep.hdr) + len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+    }
+    return 0;
+}
+#endif
 
-    if (strncmp(p->request, "GET ", 4) != 0) {
-        snprintf(p->response, sizeof(p->response), "%s", reject);
-        p->response_len = strlen(p->response);
-        return;
+#if WAYBEAM_WITH_INJECT
+// ---------------------------------------------------------------------------
+// Local injection (--inject PATH)
+//
+// Unix datagram socket for on-board producers (stabilizer, tracker) that
+// correct channels faster than the RC link runs. One datagram sets up to 16
+// channel slots at one priority and TTL; there is no reply. Overrides
+// replace the channel before mapping, offsets are added to the output after
+// prediction, and both are committed as soon as the datagram is read.
+// ---------------------------------------------------------------------------
+
+#define INJECT_VERSION 1
+
+enum { INJECT_OVERRIDE, INJECT_ADD };
+
+typedef struct {
+    uint8_t version;            // INJECT_VERSION
+    uint8_t count;              // entries that follow, 1..16
+    uint8_t prio;               // 0..254, higher wins
+    uint8_t reserved;
+    uint32_t ttl_ms;            // for every entry, 0 = until released
+} inject_hdr_t;
+
+typedef struct {
+    uint8_t crsf_ch;            // 1..16
+    uint8_t mode;               // INJECT_OVERRIDE or INJECT_ADD
+    int16_t us;                 // value (min..max) or offset, 0 = release
+} inject_entry_t;
+
+typedef struct {
+    size_t datagrams;
+    size_t applied;
+    size_t refused;             // slot held at a higher priority
+    size_t invalid;             // malformed datagrams and entries
+} inject_stats_t;
+
+static bool inject_entry_valid(const cfg_t *cfg, const inject_entry_t *e) {
+    if (e->crsf_ch < 1 || e->crsf_ch > 16) return false;
+    if (e->mode == INJECT_OVERRIDE) return !e->us || (e->us >= cfg->min_us && e->us <= cfg->max_us);
+    if (e->mode == INJECT_ADD) return abs(e->us) <= cfg->max_us - cfg->min_us;
+    return false;
+}
+
+// Drains up to INJECT_BATCH datagrams; true when any slot changed
+static bool inject_service(int fd, bridge_t *b, inject_stats_t *st, uint64_t now) {
+    const cfg_t *cfg = b->cfg;
+    bool changed = false;
+
+    for (int k = 0; k < INJECT_BATCH; k++) {
+        union {
+            inject_hdr_t hdr;
+            uint8_t buf[sizeof(inject_hdr_t) + 16 * sizeof(inject_entry_t)];
+        } msg;
+        // MSG_TRUNC: the real length, so oversized datagrams are refused, not cut
+        ssize_t n = recv(fd, msg.buf, sizeof(msg.buf), MSG_DONTWAIT | MSG_TRUNC);
+        if (n < 0) break;
+        st->datagrams++;
+        if ((size_t)n < sizeof(msg.hdr) || msg.hdr.version != INJECT_VERSION ||
+            msg.hdr.count < 1 || msg.hdr.count > 16 || msg.hdr.prio >= INJECT_PRIO_CTL ||
+            (size_t)n != sizeof(msg.hdr) + msg.hdr.count * sizeof(inject_entry_t)) {
+            st->invalid++;
+            continue;
+        }
+
+        unsigned applied = 0, refused = 0, invalid = 0;
+        for (unsigned i = 0; i < msg.hdr.count; i++) {
+            inject_entry_t e;
+            memcpy(&e, msg.buf + sizeof(msg.hdr) + i * sizeof(e), sizeof(e));
+            if (!inject_entry_valid(cfg, &e)) {
+                invalid++;
+                continue;
+            }
+            inject_slot_t *sl = e.mode == INJECT_OVERRIDE ? &b->ovr[e.crsf_ch - 1] : &b->add[e.crsf_ch - 1];
+            if (inject_set(sl, e.us, msg.hdr.prio, msg.hdr.ttl_ms, now)) {
+                applied++;
+            } else {
+                refused++;
+            }
+        }
+        st->applied += applied;
+        st->refused += refused;
+        st->invalid += invalid;
+        changed = changed || applied;
+        if (VERBOSE(cfg) > 1) {
+            LOGE(EV_INJECT, (uint32_t)msg.hdr.count, (uint32_t)msg.hdr.prio, applied, refused, invalid);
+        }
     }
+    return changed;
+}
+#endif
 
-    char *uri = p->request + 4;
-    char *space = strchr(uri, ' ');
-    if (!space) {
-        snprintf(p->response, sizeof(p->response), "%s", reject);
-        p->response_len = strlen(p->response);
-        return;
+#if WAYBEAM_WITH_PATTERN
+// Cycle length: sweep/sine/square take it as given, a staircase goes
+// LO -> HI -> LO in STEP_US increments, one hold per step.
+static uint64_t pattern_cycle_us(const pattern_t *p) {
+    if (p->shape != PAT_STEP) return (uint64_t)p->period_ms * 1000ULL;
+    int steps = (p->hi_us - p->lo_us + p->step_us - 1) / p->step_us;
+    return (uint64_t)(2 * steps) * (uint64_t)p->period_ms * 1000ULL;
+}
+
+// Output value t_us into the pattern. Every shape starts and ends a cycle at LO.
+static int pattern_value(const pattern_t *p, uint64_t t_us) {
+    uint64_t cycle_us = pattern_cycle_us(p);
+    uint64_t in = t_us % cycle_us;
+    float phase = (float)in / (float)cycle_us;
+    int span = p->hi_us - p->lo_us;
+    switch (p->shape) {
+    case PAT_SWEEP:
+        return p->lo_us + (int)((float)span * (phase < 0.5f ? 2.0f * phase : 2.0f - 2.0f * phase) + 0.5f);
+    case PAT_SINE:
+        return p->lo_us + (int)((float)span * (1.0f - cosf(2.0f * (float)M_PI * phase)) / 2.0f + 0.5f);
+    case PAT_SQUARE:
+        return phase < 0.5f ? p->lo_us : p->hi_us;
+    case PAT_STEP: {
+        int steps = (span + p->step_us - 1) / p->step_us;
+        int k = (int)(in / ((uint64_t)p->period_ms * 1000ULL));
+        if (k > steps) k = 2 * steps - k;
+        return clampi(p->lo_us + k * p->step_us, p->lo_us, p->hi_us);
     }
-    *space = '\0';
+    default:
+        return p->lo_us;
+    }
+}
 
-    if (path && path[0]) {
-        size_t plen = strlen(path);
-        if (strncmp(uri, path, plen) != 0 ||
-            (uri[plen] != '\0' && uri[plen] != '?' && uri[plen] != '#')) {
-            fprintf(stderr, "SSE: request for unexpected path '%s'\n", uri);
-            snprintf(p->response, sizeof(p->response), "%s", reject);
-            p->response_len = strlen(p->response);
-            return;
+static int pattern_check(const cfg_t *cfg) {
+    bool any = false;
+    for (int i = 0; i < cfg->out_count; i++) {
+        const pattern_t *p = &cfg->pattern[i];
+        if (p->shape == PAT_NONE) continue;
+        any = true;
+        if (p->lo_us < cfg->min_us || p->hi_us > cfg->max_us || p->lo_us >= p->hi_us ||
+            p->period_ms <= 0 || (p->shape == PAT_STEP && p->step_us <= 0)) {
+            return -1;
         }
     }
+    if (!any || cfg->pattern_cycles < 0 || cfg->pattern_rate_hz < 0 || cfg->pattern_rate_hz > 1000) return -1;
+    return 0;
+}
 
-    snprintf(p->response, sizeof(p->response), "%s", headers);
-    p->response_len = strlen(p->response);
-    p->accepted = 1;
+static void ns_to_ts(uint64_t ns, struct timespec *ts) {
+    ts->tv_sec = (time_t)(ns / 1000000000ULL);
+    ts->tv_nsec = (long)(ns % 1000000000ULL);
 }
 
-static int sse_accept_pending(int listen_fd, sse_pending_client_t *pending, uint64_t now_ms) {
-    if (listen_fd < 0) return 0;
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
 
-    struct sockaddr_in addr;
-    socklen_t addrlen = sizeof(addr);
-    int cfd = accept(listen_fd, (struct sockaddr *)&addr, &addrlen);
-    if (cfd < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
-        perror("sse accept");
-        return -1;
+// Plays the patterns on absolute CLOCK_MONOTONIC deadlines, one update per
+// PWM period by default. Values are computed from the deadline, not the wake
+// time, so a late wake delays one write but never stretches the pattern.
+// Frames overrun entirely are skipped and counted.
+static int pattern_run(const cfg_t *cfg, pwm_out_t *pwm) {
+    int rate_hz = cfg->pattern_rate_hz ? cfg->pattern_rate_hz : cfg->hz;
+    uint64_t period_ns = 1000000000ULL / (uint64_t)rate_hz;
+    uint64_t len_us[MAX_OUTPUTS] = { 0 };
+    uint64_t total_us = 0;
+    for (int i = 0; i < cfg->out_count; i++) {
+        if (cfg->pattern[i].shape == PAT_NONE || !cfg->pattern_cycles) continue;
+        len_us[i] = pattern_cycle_us(&cfg->pattern[i]) * (uint64_t)cfg->pattern_cycles;
+        if (len_us[i] > total_us) total_us = len_us[i];
+    }
+    if (VERBOSE(cfg)) {
+        fprintf(stderr, "Pattern: %d updates/s, %s\n", rate_hz,
+                total_us ? "until the last output finishes" : "until stopped");
     }
 
-    if (set_nonblock(cfd) < 0) { close(cfd); return 0; }
+    size_t frames = 0, missed = 0;
+    uint64_t late_sum = 0, late_max = 0, wr_sum = 0, wr_max = 0;
+    uint64_t t0 = mono_ns();
+    uint64_t deadline = t0;
+    while (!g_stop) {
+        uint64_t t_us = (deadline - t0) / 1000ULL;
+        if (total_us && t_us >= total_us) break;
 
-    if (pending->fd >= 0) sse_pending_close(pending);
+        uint64_t wr0 = mono_ns();
+        for (int i = 0; i < cfg->out_count; i++) {
+            const pattern_t *p = &cfg->pattern[i];
+            if (p->shape == PAT_NONE) continue;
+            // A finished output holds LO until the longest one is done
+            pwm_force_us(cfg, &pwm[i], len_us[i] && t_us >= len_us[i] ? p->lo_us : pattern_value(p, t_us));
+        }
+        uint64_t wr = mono_ns() - wr0;
+        wr_sum += wr;
+        if (wr > wr_max) wr_max = wr;
 
-    pending->fd = cfd;
-    pending->deadline_ms = now_ms + SSE_HANDSHAKE_TIMEOUT_MS;
-    pending->request_used = 0;
-    pending->response_len = 0;
-    pending->response_off = 0;
-    pending->accepted = 0;
+        deadline += period_ns;
+        struct timespec ts;
+        ns_to_ts(deadline, &ts);
+        while (!g_stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+        if (g_stop) break;
+
+        uint64_t late = mono_ns() - deadline;
+        frames++;
+        late_sum += late;
+        if (late > late_max) late_max = late;
+        if (late >= period_ns) {
+            uint64_t skip = late / period_ns;
+            missed += (size_t)skip;
+            deadline += skip * period_ns;
+        }
+    }
+
+    log_ring_stop();
+    for (int i = 0; i < cfg->out_count; i++) pwm_disarm_heartbeat(&pwm[i]);
+    pwm_failsafe_all(cfg, pwm, cfg->out_count);
+    for (int i = 0; i < cfg->out_count; i++) {
+        if (pwm[i].available && pwm[i].fd_duty >= 0) close(pwm[i].fd_duty);
+    }
+    if (frames) {
+        fprintf(stderr, "Pattern timing: frames=%zu missed=%zu wake late avg=%lluus max=%lluus "
+                "write avg=%lluus max=%lluus\n",
+                frames, missed,
+                (unsigned long long)(late_sum / frames / 1000ULL), (unsigned long long)(late_max / 1000ULL),
+                (unsigned long long)(wr_sum / frames / 1000ULL), (unsigned long long)(wr_max / 1000ULL));
+    }
+    if (VERBOSE(cfg)) {
+        for (int i = 0; i < cfg->out_count; i++) pwm_log_stats(&pwm[i]);
+    }
+    return 0;
+}
+#endif
+
+#if WAYBEAM_WITH_PWMCTL
+// One output as sysfs reports it; -1 where the attribute is missing
+typedef struct {
+    bool exported;
+    bool enabled;
+    int period_hz;
+    int duty_us;
+    char polarity[10];
+    int failsafe_us;       // heartbeat patch attributes
+    int heartbeat_ms;
+    int failsafe_active;
+} pwm_status_t;
+
+// One open/read/close, trailing newline dropped
+static int read_attr(int chip, int hw, const char *attr, char *buf, size_t len) {
+    char p[128];
+    snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/pwm%d/%s", chip, hw, attr);
+    int fd = open(p, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0) return -1;
+    if (n > 0 && buf[n - 1] == '\n') n--;
+    buf[n] = '\0';
+    return 0;
+}
+
+static int read_attr_int(int chip, int hw, const char *attr) {
+    char buf[32];
+    int v;
+    if (read_attr(chip, hw, attr, buf, sizeof(buf)) != 0 || parse_int(buf, &v) != 0) return -1;
+    return v;
+}
+
+// duty_us where the driver has it, else duty_cycle in ns
+static int read_duty_us(int chip, int hw) {
+    int us = read_attr_int(chip, hw, "duty_us");
+    if (us >= 0) return us;
+    int ns = read_attr_int(chip, hw, "duty_cycle");
+    return ns < 0 ? -1 : (ns + 500) / 1000;
+}
+
+// The atomic driver's state attribute (patch 0004) has period, duty_us,
+// polarity and enable in one read; other kernels need one read each.
+// Nothing is written, so a running output is never disturbed.
+static void pwm_read_status(int chip, int hw, bool heartbeat, pwm_status_t *st) {
+    char buf[64];
+    unsigned period, duty;
+    int en;
+    *st = (pwm_status_t){ .period_hz = -1, .duty_us = -1, .failsafe_us = -1, .heartbeat_ms = -1,
+                          .failsafe_active = -1 };
+    if (read_attr(chip, hw, "state", buf, sizeof(buf)) == 0 &&
+        sscanf(buf, "%u %u %9s %d", &period, &duty, st->polarity, &en) == 4) {
+        st->period_hz = (int)period;
+        st->duty_us = duty ? (int)duty : read_attr_int(chip, hw, "duty_us"); // 0: percent mode
+        st->enabled = en == 1;
+    } else {
+        en = read_attr_int(chip, hw, "enable");
+        if (en < 0) return;
+        st->enabled = en == 1;
+        st->period_hz = read_attr_int(chip, hw, "period");
+        if (read_attr_int(chip, hw, "duty_us") < 0 && st->period_hz > 0) {
+            st->period_hz = (int)((1000000000LL + st->period_hz / 2) / st->period_hz); // ns
+        }
+        st->duty_us = read_duty_us(chip, hw);
+        if (read_attr(chip, hw, "polarity", st->polarity, sizeof(st->polarity)) != 0) st->polarity[0] = '\0';
+    }
+    st->exported = true;
+    if (heartbeat) {
+        st->failsafe_us = read_attr_int(chip, hw, "failsafe_us");
+        st->heartbeat_ms = read_attr_int(chip, hw, "heartbeat_ms");
+        st->failsafe_active = read_attr_int(chip, hw, "failsafe_active");
+    }
+}
+
+static int pwmctl_usage(void) {
+    fprintf(stderr,
+        "Usage: pwmctl [options] COMMAND   (or: waybeam-pwm pwmctl ...)\n"
+        "  OUT is pwmN (pwmchip0) or CHIP:N, CHIP a pwmchip number or driver name\n"
+        "  get OUT               Print duty_us\n"
+        "  set OUT US            Write duty_us; an unexported or disabled output is set up first\n"
+        "  center OUT            set OUT to --center-us\n"
+        "  info [OUT] [--json]   Chips, period, duty_us, polarity, enable, heartbeat and mux state\n"
+        "  --hz N                Period for an output that needs setup (default 50)\n"
+        "  --min-us N, --max-us N, --center-us N   set limits and center (default 1000/2000/1500)\n"
+#if WAYBEAM_WITH_MUX
+        "  --no-mux, --mux-reg ADDR, --mux-pwm0 VAL, --mux-pwm1 VAL, --mux-init-val VAL\n"
+        "                        Mux handling for setup, as for the bridge\n"
+#endif
+        "  -v                    Report setup steps\n");
     return 1;
 }
 
-static int sse_service_pending(sse_pending_client_t *pending, int *client_fd,
-                               const char *path, uint64_t now_ms) {
-    if (pending->fd < 0) return 0;
+static void pwmctl_json_int(const char *key, int v) {
+    if (v < 0) {
+        printf(",\"%s\":null", key);
+    } else {
+        printf(",\"%s\":%d", key, v);
+    }
+}
 
-    // Receive HTTP request
-    if (pending->response_len == 0) {
-        while (pending->request_used < sizeof(pending->request) - 1U) {
-            ssize_t n = recv(pending->fd,
-                             pending->request + pending->request_used,
-                             (sizeof(pending->request) - 1U) - pending->request_used, 0);
-            if (n > 0) {
-                pending->request_used += (size_t)n;
-                pending->request[pending->request_used] = '\0';
-                if (sse_request_complete(pending->request)) {
-                    sse_prepare_response(pending, path);
-                    break;
-                }
-                continue;
+static void pwmctl_print_status(int chip, int hw, const pwm_status_t *s, bool json, bool first) {
+    if (json) {
+        printf("%s{\"pwm\":%d,\"exported\":%s", first ? "" : ",", hw, s->exported ? "true" : "false");
+        if (s->exported) {
+            printf(",\"enabled\":%s", s->enabled ? "true" : "false");
+            pwmctl_json_int("period_hz", s->period_hz);
+            pwmctl_json_int("duty_us", s->duty_us);
+            printf(s->polarity[0] ? ",\"polarity\":\"%s\"" : ",\"polarity\":null", s->polarity);
+            pwmctl_json_int("failsafe_us", s->failsafe_us);
+            pwmctl_json_int("heartbeat_ms", s->heartbeat_ms);
+            if (s->failsafe_active < 0) {
+                printf(",\"failsafe_active\":null");
+            } else {
+                printf(",\"failsafe_active\":%s", s->failsafe_active ? "true" : "false");
             }
-            if (n == 0) { sse_pending_close(pending); return 0; }
-            if (errno == EINTR) continue;
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            sse_pending_close(pending); return 0;
         }
+        printf("}");
+    } else if (!s->exported) {
+        printf("  %d:%d not exported\n", chip, hw);
+    } else {
+        printf("  %d:%d enabled=%d period=%dHz duty_us=%d polarity=%s", chip, hw, s->enabled,
+               s->period_hz, s->duty_us, s->polarity[0] ? s->polarity : "?");
+        if (s->heartbeat_ms >= 0) {
+            printf(" failsafe_us=%d heartbeat_ms=%d failsafe_active=%d",
+                   s->failsafe_us, s->heartbeat_ms, s->failsafe_active);
+        }
+        printf("\n");
+    }
+}
 
-        if (pending->response_len == 0 &&
-            pending->request_used >= sizeof(pending->request) - 1U) {
-            sse_pending_close(pending);
-            return 0;
+// Every chip with its exported channels, or just ONLY_HW on ONLY_CHIP.
+// pwmchip0 always lists pwm0 and pwm1, exported or not.
+static int pwmctl_info(const cfg_t *cfg, int only_chip, int only_hw, bool json) {
+    pwm_chip_t chips[MAX_PWMCHIPS];
+    int n = pwm_chips_scan(chips, MAX_PWMCHIPS);
+    int mux = -1;
+#if WAYBEAM_WITH_MUX
+    uint16_t v;
+    if (sigma_mux_rw(cfg->mux_reg, &v, false) == 0) mux = v;
+#endif
+    if (json) printf("{\"chips\":[");
+    bool first_chip = true;
+    for (int c = 0; c < n; c++) {
+        if (only_chip >= 0 && chips[c].num != only_chip) continue;
+        if (json) {
+            printf("%s{\"chip\":%d,\"npwm\":%d,\"driver\":\"%s\",\"outputs\":[", first_chip ? "" : ",",
+                   chips[c].num, chips[c].npwm, chips[c].driver);
+        } else {
+            printf("pwmchip%d: npwm=%d driver=%s\n", chips[c].num, chips[c].npwm, chips[c].driver);
+        }
+        bool first = true;
+        for (int hw = 0; hw < chips[c].npwm; hw++) {
+            if (only_hw >= 0 && hw != only_hw) continue;
+            pwm_status_t s;
+            pwm_read_status(chips[c].num, hw, true, &s);
+            if (!s.exported && only_hw < 0 && !(chips[c].num == 0 && hw < 2)) continue;
+            pwmctl_print_status(chips[c].num, hw, &s, json, first);
+            first = false;
         }
+        if (json) printf("]}");
+        first_chip = false;
     }
+    if (json) {
+        printf("],\"mux\":{\"reg\":\"%s\"", cfg->mux_reg);
+        pwmctl_json_int("value", mux);
+        printf("}}\n");
+    } else if (mux >= 0) {
+        printf("mux: %s = 0x%04x\n", cfg->mux_reg, mux);
+    } else {
+        printf("mux: %s = ?\n", cfg->mux_reg);
+    }
+    return 0;
+}
 
-    if (pending->response_len == 0) {
-        if (now_ms >= pending->deadline_ms) {
-            fprintf(stderr, "SSE: client handshake timed out\n");
-            sse_pending_close(pending);
+// A running output gets exactly one duty write. Otherwise it is set up
+// like the bridge does (mux, export, period), starting directly at US.
+static int pwmctl_set(cfg_t *cfg, int chip, int hw, int us, bool mux_explicit) {
+    pwm_status_t st;
+    pwm_read_status(chip, hw, false, &st);
+    if (st.exported && st.enabled) {
+        char p[128];
+        int v = us;
+        snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/pwm%d/duty_us", chip, hw);
+        if (!path_exists(p)) {
+            snprintf(p, sizeof(p), PWM_CLASS "/pwmchip%d/pwm%d/duty_cycle", chip, hw);
+            v = us * 1000;
+        }
+        if (write_int_path(p, v) != 0) {
+            fprintf(stderr, "%d:%d: write %s: %s\n", chip, hw, p, strerror(errno));
+            return 1;
         }
         return 0;
     }
 
-    // Send HTTP response
-    while (pending->response_off < pending->response_len) {
-        ssize_t n = send(pending->fd,
-                         pending->response + pending->response_off,
-                         pending->response_len - pending->response_off,
-                         MSG_NOSIGNAL);
-        if (n > 0) { pending->response_off += (size_t)n; continue; }
-        if (n < 0 && errno == EINTR) continue;
-        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            if (now_ms >= pending->deadline_ms) {
-                fprintf(stderr, "SSE: client handshake timed out\n");
-                sse_pending_close(pending);
+#if WAYBEAM_WITH_MUX
+    // The other output running means the dual-channel mux value, as at bridge startup
+    if (chip == 0 && hw < 2) {
+        pwm_status_t other;
+        pwm_read_status(0, !hw, false, &other);
+        if (!cfg->no_mux && !mux_explicit && other.exported && other.enabled) {
+            cfg->mux_init_once = true;
+            cfg->mux_init_val = 0x1122;
+        }
+        if (!cfg->no_mux && cfg->mux_init_once && sigma_mux_set_value(cfg, cfg->mux_init_val) != 0) {
+            fprintf(stderr, "WARN: mux write to %s failed: %s (continuing)\n", cfg->mux_reg, strerror(errno));
+        }
+    }
+#else
+    (void)mux_explicit;
+#endif
+    // Set up through output slot 0
+    pwm_out_t o;
+    cfg->out_addr[0].chip = chip;
+    cfg->out_addr[0].hw = hw;
+    cfg->failsafe_us[0] = us;
+    if (pwm_init_one(cfg, &o, 0) != 0) return 1;
+    if (o.fd_duty >= 0) close(o.fd_duty);
+    return 0;
+}
+
+// pwmN on pwmchip0, or CHIP:N with CHIP a number or driver name
+static int pwmctl_output(const char *s, int *chip, int *hw) {
+    char driver[24];
+    int n;
+    if (!strncmp(s, "pwm", 3) && parse_int(s + 3, &n) == 0 && n >= 0) {
+        *chip = 0;
+        *hw = n;
+        return 0;
+    }
+    if (parse_out_addr(s, chip, hw, driver, sizeof(driver)) != 0) {
+        fprintf(stderr, "Unknown output: %s (pwmN or CHIP:N)\n", s);
+        return -1;
+    }
+    if (*chip < 0) {
+        pwm_chip_t chips[MAX_PWMCHIPS];
+        int n_chips = pwm_chips_scan(chips, MAX_PWMCHIPS);
+        const pwm_chip_t *c = pwm_chip_by_driver(chips, n_chips, driver);
+        if (!c) {
+            fprintf(stderr, "No pwmchip bound to driver %s\n", driver);
+            return -1;
+        }
+        *chip = c->num;
+    }
+    return 0;
+}
+
+// argv holds only what follows "pwmctl"; cfg comes with the bridge defaults
+static int pwmctl_main(cfg_t *cfg, int argc, char **argv) {
+    const char *pos[3];
+    int npos = 0;
+    bool json = false;
+    bool mux_explicit = false;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--hz")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg->hz, "--hz")) return 1;
+        } else if (!strcmp(argv[i], "--min-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg->min_us, "--min-us")) return 1;
+        } else if (!strcmp(argv[i], "--max-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg->max_us, "--max-us")) return 1;
+        } else if (!strcmp(argv[i], "--center-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg->center_us, "--center-us")) return 1;
+#if WAYBEAM_WITH_MUX
+        } else if (!strcmp(argv[i], "--no-mux")) {
+            cfg->no_mux = true;
+        } else if (!strcmp(argv[i], "--mux-reg")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --mux-reg\n");
+                return 1;
             }
-            return 0;
+            cfg->mux_reg = argv[++i];
+        } else if (!strcmp(argv[i], "--mux-pwm0")) {
+            if (!parse_opt_u16_or_die(argc, argv, &i, &cfg->mux_pwm0, "--mux-pwm0")) return 1;
+            mux_explicit = true;
+        } else if (!strcmp(argv[i], "--mux-pwm1")) {
+            if (!parse_opt_u16_or_die(argc, argv, &i, &cfg->mux_pwm1, "--mux-pwm1")) return 1;
+            mux_explicit = true;
+        } else if (!strcmp(argv[i], "--mux-init-val")) {
+            if (!parse_opt_u16_or_die(argc, argv, &i, &cfg->mux_init_val, "--mux-init-val")) return 1;
+            cfg->mux_init_once = true;
+            mux_explicit = true;
+#endif
+        } else if (!strcmp(argv[i], "-v")) {
+            cfg->verbose = 1;
+        } else if (argv[i][0] == '-' || npos == 3) {
+            return pwmctl_usage();
+        } else {
+            pos[npos++] = argv[i];
         }
-        sse_pending_close(pending); return 0;
+    }
+    if (!npos || cfg->hz <= 0 || cfg->min_us < 500 || cfg->max_us > 2500 || cfg->min_us > cfg->max_us ||
+        cfg->center_us < cfg->min_us || cfg->center_us > cfg->max_us) {
+        return pwmctl_usage();
     }
 
-    if (!pending->accepted) { sse_pending_close(pending); return 0; }
+    const char *cmd = pos[0];
+    if (!strcmp(cmd, "info")) {
+        if (npos > 2) return pwmctl_usage();
+        int chip = -1, hw = -1;
+        if (npos == 2 && pwmctl_output(pos[1], &chip, &hw) != 0) return 1;
+        return pwmctl_info(cfg, chip, hw, json);
+    }
+    if (npos < 2 || json) return pwmctl_usage();
+    int chip, hw;
+    if (pwmctl_output(pos[1], &chip, &hw) != 0) return 1;
 
-    // Promote to active client
-    if (*client_fd >= 0) close(*client_fd);
-    *client_fd = pending->fd;
-    pending->fd = -1;
-    sse_pending_reset(pending);
-    fprintf(stderr, "SSE: client connected\n");
-    return 1;
+    if (!strcmp(cmd, "get") && npos == 2) {
+        int us = read_duty_us(chip, hw);
+        if (us < 0) {
+            fprintf(stderr, "%d:%d: read duty: %s\n", chip, hw, strerror(errno));
+            return 1;
+        }
+        printf("%d\n", us);
+        return 0;
+    }
+    if (!strcmp(cmd, "center") && npos == 2) return pwmctl_set(cfg, chip, hw, cfg->center_us, mux_explicit);
+    if (!strcmp(cmd, "set") && npos == 3) {
+        int us;
+        if (parse_int(pos[2], &us) != 0 || us < cfg->min_us || us > cfg->max_us) {
+            fprintf(stderr, "Invalid pulse width: %s (expected %d..%d us)\n", pos[2], cfg->min_us, cfg->max_us);
+            return 1;
+        }
+        return pwmctl_set(cfg, chip, hw, us, mux_explicit);
+    }
+    return pwmctl_usage();
 }
+#endif
 
-static int sse_send_channels(int fd, const int ch_us[16], bool link_active,
-                             bool failsafe, size_t rc_frames) {
-    if (fd < 0) return 0;
-
-    // Convert microseconds back to CRSF ticks for waybeam_hub compatibility
-    int ticks[16];
-    for (int i = 0; i < 16; i++)
-        ticks[i] = ((ch_us[i] - 1500) * 8) / 5 + 992;
-
-    char buf[512];
-    int off = snprintf(buf, sizeof(buf),
-        "event: serial\ndata: {\"stream\":\"serial\",\"channels\":[");
-    if (off < 0 || off >= (int)sizeof(buf)) return -1;
-
-    for (int i = 0; i < 16; i++) {
-        off += snprintf(buf + off, sizeof(buf) - (size_t)off,
-                        i ? ",%d" : "%d", ticks[i]);
-        if (off < 0 || off >= (int)sizeof(buf)) return -1;
+// Readiness for init scripts: outputs are centered and every input is bound.
+// The pidfile is written first, so whoever wakes on the notify fd can use
+// it. The fd gets one line and is closed; a reader that sees EOF without
+// the line knows startup failed, whatever the exit path.
+static void notify_ready(const cfg_t *cfg) {
+    if (cfg->pidfile[0]) {
+        FILE *f = fopen(cfg->pidfile, "w");
+        bool ok = f && fprintf(f, "%ld\n", (long)getpid()) > 0;
+        if (f && fclose(f) != 0) ok = false;
+        if (!ok) fprintf(stderr, "WARN: cannot write pidfile %s: %s\n", cfg->pidfile, strerror(errno));
+    }
+    if (cfg->notify_fd >= 0) {
+        static const char msg[] = "READY=1\n";
+        // A reader that gave up must not SIGPIPE the running bridge
+        signal(SIGPIPE, SIG_IGN);
+        if (write(cfg->notify_fd, msg, sizeof(msg) - 1) < 0) {
+            fprintf(stderr, "WARN: --notify-fd %d: %s\n", cfg->notify_fd, strerror(errno));
+        }
+        close(cfg->notify_fd);
     }
-
-    off += snprintf(buf + off, sizeof(buf) - (size_t)off,
-        "],\"link\":%s,\"rc_frames\":%zu,\"failsafe\":%s}\n\n",
-        link_active ? "true" : "false", rc_frames,
-        failsafe ? "true" : "false");
-    if (off < 0 || off >= (int)sizeof(buf)) return -1;
-
-    return sse_send_all(fd, buf, (size_t)off);
 }
 
 int main(int argc, char **argv) {
     cfg_t cfg = {
         .port = 9000,
-        .pwm0_ch = 1,   // CRSF CH1 -> pwm0
-        .pwm1_ch = 2,   // CRSF CH2 -> pwm1
+        .uart_dev = "",
+        .uart_baud = 0,      // --proto default
+        .out_count = 2,
+        .out_ch = { 1, 2 },  // CRSF CH1 -> pwm0, CH2 -> pwm1
+        .out_addr = { { .chip = 0, .hw = 0 }, { .chip = 0, .hw = 1 } },
         .hz = 50,
         .min_us = 1000,
         .max_us = 2000,
         .center_us = 1500,
         .hold_ms = 300,
         .center_timeout_ms = 500,
+        .adaptive_timeouts = false,
+        .adaptive_hold_x = 3,
+        .adaptive_center_x = 10,
+        .adaptive_min_ms = 20,
+        .adaptive_max_ms = 2000,
+        .predict = PREDICT_OFF,
+        .predict_horizon_ms = PREDICT_DEFAULT_HORIZON_MS,
+        .predict_max_us = PREDICT_DEFAULT_MAX_US,
+        .deadband_us = {0, 0},
+        .hysteresis_us = {0, 0},
         .verbose = 0,
-        .no_mux = false,
+        .kernel_failsafe = false,
+        .peer_lock = false,
+        .peer_relearn_ms = PEER_RELEARN_DEFAULT_MS,
+        .no_mux = !WAYBEAM_WITH_MUX,
         .mux_init_once = false,
         .mux_init_val = 0,
         .mux_pwm0 = 0x1102,
@@ -745,16 +4170,65 @@ int main(int argc, char **argv) {
         .sse_port = SSE_DEFAULT_PORT,
         .sse_path = SSE_DEFAULT_PATH,
         .sse_rate_hz = SSE_DEFAULT_RATE_HZ,
+        .pattern_cycles = 1,
+        .notify_fd = -1,
+        .http_prio = HTTP_DEFAULT_PRIO,
+        .http_ttl_ms = HTTP_DEFAULT_TTL_MS,
     };
+#if WAYBEAM_WITH_PWMCTL
+    // Also reachable as a "pwmctl" symlink
+    const char *prog = strrchr(argv[0], '/');
+    prog = prog ? prog + 1 : argv[0];
+    if (!strcmp(prog, "pwmctl")) return pwmctl_main(&cfg, argc - 1, argv + 1);
+    if (argc > 1 && !strcmp(argv[1], "pwmctl")) return pwmctl_main(&cfg, argc - 2, argv + 2);
+#endif
     bool mux_strategy_explicit = false;
+    int argi = 1;
+#if WAYBEAM_WITH_PATTERN
+    bool pattern_mode = argc > 1 && !strcmp(argv[1], "pattern");
+    if (pattern_mode) argi = 2;
+#endif
+#if WAYBEAM_WITH_TRACE
+    bool trace_marker_requested = false;
+#endif
 
-    for (int i = 1; i < argc; i++) {
+    for (int i = argi; i < argc; i++) {
         if (!strcmp(argv[i], "--port")) {
             if (!parse_opt_int_or_die(argc, argv, &i, &cfg.port, "--port")) return 1;
+#if WAYBEAM_WITH_UART
+        } else if (!strcmp(argv[i], "--uart")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --uart\n");
+                return 1;
+            }
+            snprintf(cfg.uart_dev, sizeof(cfg.uart_dev), "%s", argv[++i]);
+        } else if (!strcmp(argv[i], "--uart-baud")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.uart_baud, "--uart-baud")) return 1;
+#endif
         } else if (!strcmp(argv[i], "--pwm0-ch")) {
-            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.pwm0_ch, "--pwm0-ch")) return 1;
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.out_ch[0], "--pwm0-ch")) return 1;
         } else if (!strcmp(argv[i], "--pwm1-ch")) {
-            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.pwm1_ch, "--pwm1-ch")) return 1;
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.out_ch[1], "--pwm1-ch")) return 1;
+        } else if (!strcmp(argv[i], "--out")) {
+            const char *val = (i + 1 < argc) ? argv[++i] : NULL;
+            const char *eq = val ? strrchr(val, '=') : NULL;
+            char addr[64];
+            int n = cfg.out_count;
+            if (n == MAX_OUTPUTS) {
+                fprintf(stderr, "Too many outputs (max %d)\n", MAX_OUTPUTS);
+                return 1;
+            }
+            if (!eq || (size_t)(eq - val) >= sizeof(addr) || parse_int(eq + 1, &cfg.out_ch[n]) != 0) {
+                fprintf(stderr, "Invalid value for --out: %s (expected CHIP:N=CH)\n", val ? val : "");
+                return 1;
+            }
+            snprintf(addr, sizeof(addr), "%.*s", (int)(eq - val), val);
+            if (parse_out_addr(addr, &cfg.out_addr[n].chip, &cfg.out_addr[n].hw, cfg.out_addr[n].driver,
+                               sizeof(cfg.out_addr[n].driver)) != 0) {
+                fprintf(stderr, "Invalid output address for --out: %s (expected CHIP:N)\n", addr);
+                return 1;
+            }
+            cfg.out_count++;
         } else if (!strcmp(argv[i], "--hz")) {
             if (!parse_opt_int_or_die(argc, argv, &i, &cfg.hz, "--hz")) return 1;
         } else if (!strcmp(argv[i], "--min-us")) {
@@ -767,9 +4241,135 @@ int main(int argc, char **argv) {
             if (!parse_opt_int_or_die(argc, argv, &i, &cfg.hold_ms, "--hold-ms")) return 1;
         } else if (!strcmp(argv[i], "--center-timeout-ms")) {
             if (!parse_opt_int_or_die(argc, argv, &i, &cfg.center_timeout_ms, "--center-timeout-ms")) return 1;
+        } else if (!strcmp(argv[i], "--rcvbuf")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.rcvbuf, "--rcvbuf")) return 1;
+        } else if (!strcmp(argv[i], "--max-age-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.max_age_ms, "--max-age-ms")) return 1;
+#if WAYBEAM_WITH_ECHO
+        } else if (!strcmp(argv[i], "--echo")) {
+            cfg.echo = true;
+#endif
+        } else if (!strcmp(argv[i], "--proto")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --proto\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            cfg.proto = rc_proto_by_name(val);
+            if (cfg.proto < 0) {
+                fprintf(stderr, "Invalid value for --proto: %s (", val);
+                for (size_t k = 0, n = 0; k < sizeof(rc_protos) / sizeof(rc_protos[0]); k++) {
+                    if (rc_protos[k].built) fprintf(stderr, "%s%s", n++ ? ", " : "", rc_protos[k].name);
+                }
+                fprintf(stderr, ")\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--peer-lock")) {
+            cfg.peer_lock = true;
+        } else if (!strcmp(argv[i], "--peer-relearn-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.peer_relearn_ms, "--peer-relearn-ms")) return 1;
+        } else if (!strcmp(argv[i], "--adaptive-timeouts")) {
+            cfg.adaptive_timeouts = true;
+        } else if (!strcmp(argv[i], "--adaptive-hold-x")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.adaptive_hold_x, "--adaptive-hold-x")) return 1;
+        } else if (!strcmp(argv[i], "--adaptive-center-x")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.adaptive_center_x, "--adaptive-center-x")) return 1;
+        } else if (!strcmp(argv[i], "--adaptive-min-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.adaptive_min_ms, "--adaptive-min-ms")) return 1;
+        } else if (!strcmp(argv[i], "--adaptive-max-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.adaptive_max_ms, "--adaptive-max-ms")) return 1;
+        } else if (!strcmp(argv[i], "--predict")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --predict\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (!strcmp(val, "linear")) {
+                cfg.predict = PREDICT_LINEAR;
+            } else if (!strcmp(val, "ab")) {
+                cfg.predict = PREDICT_AB;
+            } else if (!strcmp(val, "off")) {
+                cfg.predict = PREDICT_OFF;
+            } else {
+                fprintf(stderr, "Invalid value for --predict: %s (linear, ab, off)\n", val);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--predict-horizon-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.predict_horizon_ms, "--predict-horizon-ms")) return 1;
+        } else if (!strcmp(argv[i], "--predict-max-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.predict_max_us, "--predict-max-us")) return 1;
+        } else if (!strcmp(argv[i], "--failsafe") || !strcmp(argv[i], "--pwm0-failsafe") ||
+                   !strcmp(argv[i], "--pwm1-failsafe")) {
+            const char *opt = argv[i];
+            int idx = strcmp(opt, "--failsafe") ? opt[5] - '0' : -1;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for %s\n", opt);
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (idx < 0 && !(val = parse_out_opt(&cfg, opt, val, &idx))) return 1;
+            if (parse_failsafe_spec(val, &cfg.failsafe_us[idx], &cfg.failsafe_ramp_ms[idx],
+                                    &cfg.failsafe_hold[idx]) != 0) {
+                fprintf(stderr, "Invalid value for %s: %s (center, hold, US or US/MS)\n", opt, val);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--kernel-failsafe")) {
+            cfg.kernel_failsafe = true;
+#if WAYBEAM_WITH_BPF
+        } else if (!strcmp(argv[i], "--udp-filter")) {
+            cfg.udp_filter = true;
+        } else if (!strcmp(argv[i], "--allow-src")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --allow-src\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (cfg.allow_src_count >= MAX_ALLOW_SRC) {
+                fprintf(stderr, "Too many --allow-src entries (max %d)\n", MAX_ALLOW_SRC);
+                return 1;
+            }
+            if (parse_allow_src(val, &cfg.allow_src[cfg.allow_src_count].addr,
+                                &cfg.allow_src[cfg.allow_src_count].port) != 0) {
+                fprintf(stderr, "Invalid value for --allow-src: %s\n", val);
+                return 1;
+            }
+            cfg.allow_src_count++;
+            cfg.udp_filter = true;
+#endif
+#if WAYBEAM_WITH_TRACE
+        } else if (!strcmp(argv[i], "--trace-marker")) {
+            trace_marker_requested = true;
+#endif
+        } else if ((!strcmp(argv[i], "--deadband-us") || !strcmp(argv[i], "--hysteresis-us")) &&
+                   i + 1 < argc && strchr(argv[i + 1], '=')) {
+            // OUT=N: one output
+            const char *opt = argv[i];
+            int *arr = !strcmp(opt, "--deadband-us") ? cfg.deadband_us : cfg.hysteresis_us;
+            int idx;
+            const char *val = parse_out_opt(&cfg, opt, argv[++i], &idx);
+            if (!val) return 1;
+            if (parse_int(val, &arr[idx]) != 0) {
+                fprintf(stderr, "Invalid value for %s: %s\n", opt, argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--deadband-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.deadband_us[0], "--deadband-us")) return 1;
+            for (int k = 1; k < MAX_OUTPUTS; k++) cfg.deadband_us[k] = cfg.deadband_us[0];
+        } else if (!strcmp(argv[i], "--hysteresis-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.hysteresis_us[0], "--hysteresis-us")) return 1;
+            for (int k = 1; k < MAX_OUTPUTS; k++) cfg.hysteresis_us[k] = cfg.hysteresis_us[0];
+        } else if (!strcmp(argv[i], "--pwm0-deadband-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.deadband_us[0], "--pwm0-deadband-us")) return 1;
+        } else if (!strcmp(argv[i], "--pwm1-deadband-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.deadband_us[1], "--pwm1-deadband-us")) return 1;
+        } else if (!strcmp(argv[i], "--pwm0-hysteresis-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.hysteresis_us[0], "--pwm0-hysteresis-us")) return 1;
+        } else if (!strcmp(argv[i], "--pwm1-hysteresis-us")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.hysteresis_us[1], "--pwm1-hysteresis-us")) return 1;
         } else if (!strcmp(argv[i], "--no-mux")) {
             cfg.no_mux = true;
             mux_strategy_explicit = true;
+#if WAYBEAM_WITH_MUX
         } else if (!strcmp(argv[i], "--mux-reg")) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Missing value for --mux-reg\n");
@@ -788,6 +4388,8 @@ int main(int argc, char **argv) {
             if (!parse_opt_u16_or_die(argc, argv, &i, &cfg.mux_init_val, "--mux-init-val")) return 1;
             cfg.mux_init_once = true;
             mux_strategy_explicit = true;
+#endif
+#if WAYBEAM_WITH_SSE
         } else if (!strcmp(argv[i], "--sse")) {
             cfg.sse_enabled = true;
         } else if (!strcmp(argv[i], "--sse-bind")) {
@@ -821,6 +4423,97 @@ int main(int argc, char **argv) {
             if (!parse_opt_int_or_die(argc, argv, &i, &cfg.sse_rate_hz, "--sse-rate")) return 1;
             if (cfg.sse_rate_hz < 1) cfg.sse_rate_hz = 1;
             if (cfg.sse_rate_hz > 100) cfg.sse_rate_hz = 100;
+#endif
+#if WAYBEAM_WITH_HTTP
+        } else if (!strcmp(argv[i], "--http-outputs")) {
+            cfg.http_outputs = true;
+            cfg.sse_enabled = true;
+        } else if (!strcmp(argv[i], "--http-prio")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.http_prio, "--http-prio")) return 1;
+        } else if (!strcmp(argv[i], "--http-ttl-ms")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.http_ttl_ms, "--http-ttl-ms")) return 1;
+        } else if (!strcmp(argv[i], "--http-link")) {
+            cfg.http_link = true;
+        } else if (!strcmp(argv[i], "--http-origin")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --http-origin\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            // Copied into a header line: no spaces or control characters
+            size_t len = strlen(val);
+            bool ok = len > 0 && len < sizeof(cfg.http_origin);
+            for (size_t k = 0; ok && k < len; k++) ok = val[k] > ' ' && val[k] < 0x7f;
+            if (!ok) {
+                fprintf(stderr, "Invalid value for --http-origin: %s\n", val);
+                return 1;
+            }
+            snprintf(cfg.http_origin, sizeof(cfg.http_origin), "%s", val);
+#endif
+#if WAYBEAM_WITH_CTL
+        } else if (!strcmp(argv[i], "--ctl")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --ctl\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (!val[0] || strlen(val) >= sizeof(cfg.ctl_path)) {
+                fprintf(stderr, "Invalid value for --ctl: %s\n", val);
+                return 1;
+            }
+            snprintf(cfg.ctl_path, sizeof(cfg.ctl_path), "%s", val);
+#endif
+#if WAYBEAM_WITH_INJECT
+        } else if (!strcmp(argv[i], "--inject")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --inject\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (!val[0] || strlen(val) >= sizeof(cfg.inject_path)) {
+                fprintf(stderr, "Invalid value for --inject: %s\n", val);
+                return 1;
+            }
+            snprintf(cfg.inject_path, sizeof(cfg.inject_path), "%s", val);
+#endif
+        } else if (!strcmp(argv[i], "--pidfile")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --pidfile\n");
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (!val[0] || strlen(val) >= sizeof(cfg.pidfile)) {
+                fprintf(stderr, "Invalid value for --pidfile: %s\n", val);
+                return 1;
+            }
+            snprintf(cfg.pidfile, sizeof(cfg.pidfile), "%s", val);
+        } else if (!strcmp(argv[i], "--notify-fd")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.notify_fd, "--notify-fd")) return 1;
+            if (cfg.notify_fd < 0 || fcntl(cfg.notify_fd, F_GETFD) < 0) {
+                fprintf(stderr, "Invalid value for --notify-fd: %d is not an open fd\n", cfg.notify_fd);
+                return 1;
+            }
+#if WAYBEAM_WITH_PATTERN
+        } else if (pattern_mode && (!strcmp(argv[i], "--pattern") || !strcmp(argv[i], "--pwm0-pattern") ||
+                                    !strcmp(argv[i], "--pwm1-pattern"))) {
+            const char *opt = argv[i];
+            int idx = strcmp(opt, "--pattern") ? opt[5] - '0' : -1;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for %s\n", opt);
+                return 1;
+            }
+            const char *val = argv[++i];
+            if (idx < 0 && !(val = parse_out_opt(&cfg, opt, val, &idx))) return 1;
+            if (parse_pattern_spec(val, &cfg.pattern[idx]) != 0) {
+                fprintf(stderr, "Invalid value for %s: %s (sweep|sine|square:LO-HI:MS or step:LO-HI:US:MS)\n",
+                        opt, val);
+                return 1;
+            }
+        } else if (pattern_mode && !strcmp(argv[i], "--cycles")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.pattern_cycles, "--cycles")) return 1;
+        } else if (pattern_mode && !strcmp(argv[i], "--rate-hz")) {
+            if (!parse_opt_int_or_die(argc, argv, &i, &cfg.pattern_rate_hz, "--rate-hz")) return 1;
+#endif
         }
         else if (argv[i][0] == '-' && argv[i][1] == 'v') {
             const char *p = &argv[i][1];
@@ -839,96 +4532,306 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (cfg.port <= 0 || cfg.port > 65535 ||
+    if (!cfg.uart_baud) cfg.uart_baud = rc_protos[cfg.proto].baud;
+    if (cfg.port < 0 || cfg.port > 65535 ||
+        (cfg.port == 0 && (!cfg.uart_dev[0] || cfg.echo)) ||
+        (cfg.echo && cfg.proto != PROTO_CRSF) ||
+        cfg.uart_baud <= 0 ||
+        cfg.peer_relearn_ms < 0 ||
+        cfg.http_prio < 0 || cfg.http_prio >= INJECT_PRIO_CTL || cfg.http_ttl_ms < 0 ||
+        cfg.rcvbuf < 0 || cfg.max_age_ms < 0 ||
         cfg.hz <= 0 ||
         cfg.min_us < 500 || cfg.max_us > 2500 ||
         cfg.center_us < cfg.min_us || cfg.center_us > cfg.max_us ||
         cfg.hold_ms < 0 || cfg.center_timeout_ms < cfg.hold_ms ||
-        cfg.pwm0_ch < 0 || cfg.pwm0_ch > 16 ||
-        cfg.pwm1_ch < 0 || cfg.pwm1_ch > 16) {
+        cfg.adaptive_hold_x < 1 || cfg.adaptive_center_x < cfg.adaptive_hold_x ||
+        cfg.adaptive_min_ms < 1 || cfg.adaptive_max_ms < cfg.adaptive_min_ms ||
+        cfg.predict_horizon_ms < 0 || cfg.predict_max_us < 0) {
         fprintf(stderr, "Invalid arguments\n");
         return 1;
     }
+    for (int i = 0; i < MAX_OUTPUTS; i++) {
+        if ((i < cfg.out_count && (cfg.out_ch[i] < 0 || cfg.out_ch[i] > 16)) ||
+            cfg.deadband_us[i] < 0 || cfg.deadband_us[i] > 100 ||
+            cfg.hysteresis_us[i] < 0 || cfg.hysteresis_us[i] > 100 ||
+            (cfg.failsafe_us[i] && (cfg.failsafe_us[i] < cfg.min_us || cfg.failsafe_us[i] > cfg.max_us))) {
+            fprintf(stderr, "Invalid arguments\n");
+            return 1;
+        }
+    }
+
+    // Outputs in use: mapped to a CRSF channel, or given a pattern in pattern mode
+    bool used[MAX_OUTPUTS];
+    for (int i = 0; i < cfg.out_count; i++) used[i] = cfg.out_ch[i] > 0;
+#if WAYBEAM_WITH_PATTERN
+    if (pattern_mode) {
+        if (pattern_check(&cfg) != 0) {
+            fprintf(stderr, "Invalid pattern arguments\n");
+            return 1;
+        }
+        for (int i = 0; i < cfg.out_count; i++) used[i] = cfg.pattern[i].shape != PAT_NONE;
+    }
+#endif
+
+    // --out addresses against the chips actually present: driver names
+    // resolved, channel within npwm, no pwm driven by two outputs
+    pwm_chip_t chips[MAX_PWMCHIPS];
+    int n_chips = pwm_chips_scan(chips, MAX_PWMCHIPS);
+    bool soc_used[2] = { false, false };
+    for (int i = 0; i < cfg.out_count; i++) {
+        if (!used[i]) continue;
+        const pwm_chip_t *c;
+        if (cfg.out_addr[i].driver[0]) {
+            c = pwm_chip_by_driver(chips, n_chips, cfg.out_addr[i].driver);
+            if (!c) {
+                fprintf(stderr, "No pwmchip bound to driver %s\n", cfg.out_addr[i].driver);
+                return 1;
+            }
+            cfg.out_addr[i].chip = c->num;
+        } else {
+            c = pwm_chip_find(chips, n_chips, cfg.out_addr[i].chip);
+        }
+        // pwmchip0 may be missing from a scan on kernels without npwm; pwm_init_one reports it
+        if (c && c->npwm > 0 && cfg.out_addr[i].hw >= c->npwm) {
+            fprintf(stderr, "pwmchip%d has no pwm%d (npwm=%d)\n", c->num, cfg.out_addr[i].hw, c->npwm);
+            return 1;
+        }
+        if (i >= 2 && !c) {
+            fprintf(stderr, "No pwmchip%d under " PWM_CLASS "\n", cfg.out_addr[i].chip);
+            return 1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (used[j] && cfg.out_addr[j].chip == cfg.out_addr[i].chip && cfg.out_addr[j].hw == cfg.out_addr[i].hw) {
+                fprintf(stderr, "pwmchip%d/pwm%d is used by two outputs\n", cfg.out_addr[i].chip,
+                        cfg.out_addr[i].hw);
+                return 1;
+            }
+        }
+        if (cfg.out_addr[i].chip == 0 && cfg.out_addr[i].hw < 2) soc_used[cfg.out_addr[i].hw] = true;
+    }
+    if (VERBOSE(&cfg)) {
+        fprintf(stderr, "PWM chips:");
+        for (int c = 0; c < n_chips; c++) {
+            fprintf(stderr, " pwmchip%d(npwm=%d %s)", chips[c].num, chips[c].npwm, chips[c].driver);
+        }
+        fprintf(stderr, "%s\n", n_chips ? "" : " none found under " PWM_CLASS);
+    }
 
     // Default for known board behavior: dual-channel works with one combined mux write.
-    if (!cfg.no_mux && !mux_strategy_explicit && cfg.pwm0_ch > 0 && cfg.pwm1_ch > 0) {
+    if (!cfg.no_mux && !mux_strategy_explicit && soc_used[0] && soc_used[1]) {
         cfg.mux_init_once = true;
         cfg.mux_init_val = 0x1122;
     }
 
     signal(SIGINT, on_sig);
     signal(SIGTERM, on_sig);
+    if (cfg.peer_lock) signal(SIGHUP, on_hup);
+
+#if WAYBEAM_WITH_TRACE
+    if (trace_marker_requested && trace_marker_open() != 0) {
+        fprintf(stderr, "WARN: trace_marker not available (tracefs not mounted?), probes disabled\n");
+    }
+#endif
 
+#if WAYBEAM_WITH_MUX
     if (!cfg.no_mux && cfg.mux_init_once) {
         if (sigma_mux_set_value(&cfg, cfg.mux_init_val) != 0) {
-            if (cfg.verbose) {
+            if (VERBOSE(&cfg)) {
                 fprintf(stderr, "WARN: one-shot mux write failed for %s=0x%04x (continuing)\n",
                         cfg.mux_reg, cfg.mux_init_val);
             }
-        } else if (cfg.verbose) {
+        } else if (VERBOSE(&cfg)) {
             fprintf(stderr, "MUX: one-shot write %s = 0x%04x\n", cfg.mux_reg, cfg.mux_init_val);
         }
     }
+#endif
 
-    pwm_out_t pwm0 = {0}, pwm1 = {0};
-
-    if (cfg.pwm0_ch > 0 && pwm_init_one(&cfg, &pwm0, 0) != 0) return 1;
-    if (cfg.pwm1_ch > 0 && pwm_init_one(&cfg, &pwm1, 1) != 0) return 1;
+    pwm_out_t pwm[MAX_OUTPUTS];
+    memset(pwm, 0, sizeof(pwm));
+    for (int i = 0; i < cfg.out_count; i++) {
+        if (used[i] && pwm_init_one(&cfg, &pwm[i], i) != 0) return 1;
+    }
 
-    // Start centered (safe startup)
-    pwm_center_all(&cfg, &pwm0, &pwm1);
+    // Start at the failsafe values (safe startup)
+    pwm_failsafe_all(&cfg, pwm, cfg.out_count);
 
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        perror("socket");
-        return 1;
+#if WAYBEAM_WITH_PATTERN
+    if (pattern_mode) {
+        if (VERBOSE(&cfg)) log_ring_start();
+        return pattern_run(&cfg, pwm);
     }
+#endif
 
-    int one = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
-
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons((uint16_t)cfg.port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    int sock = -1;
+    if (cfg.port > 0) {
+        sock = open_udp_socket(cfg.port);
+        if (sock < 0) return 1;
+        udp_tune_socket(sock, &cfg);
+#if WAYBEAM_WITH_BPF
+        if (cfg.udp_filter) {
+            int insns = udp_attach_filter(sock, &cfg);
+            if (insns < 0) {
+                close(sock);
+                return 1;
+            }
+            if (VERBOSE(&cfg)) {
+                fprintf(stderr, "UDP filter: %s datagrams only, %s (%d BPF insns)\n",
+                        rc_protos[cfg.proto].label,
+                        cfg.allow_src_count ? "allow-listed sources" : "any source", insns);
+            }
+        }
+#endif
+    }
 
-    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
-        perror("bind");
-        close(sock);
-        return 1;
+    int uart_fd = -1;
+#if WAYBEAM_WITH_UART
+    if (cfg.uart_dev[0]) {
+        uart_fd = open_uart(cfg.uart_dev, cfg.uart_baud, rc_protos[cfg.proto].format);
+        if (uart_fd < 0) {
+            if (sock >= 0) close(sock);
+            return 1;
+        }
     }
+#endif
+
+    bridge_t br = {
+        .cfg = &cfg,
+        .last_valid_ms = 0,
+        .link_active = false,
+        .centered = true,   // already centered at startup
+        .total_rc_frames = 0,
+    };
+    bridge_set_outputs(&br, pwm, cfg.out_count);
+    for (int i = 0; i < 16; i++) br.last_ch_us[i] = cfg.center_us;
+    linkq_init(&br.lq, &cfg);
 
+#if WAYBEAM_WITH_SSE
     // SSE server setup
     int sse_listen_fd = -1;
     int sse_client_fd = -1;
     sse_pending_client_t sse_pending;
     sse_pending_reset(&sse_pending);
     uint64_t next_sse_emit_ms = 0;
-    size_t total_rc_frames = 0;
-    int last_ch_us[16];
-    for (int i = 0; i < 16; i++) last_ch_us[i] = cfg.center_us;
 
     if (cfg.sse_enabled) {
         sse_listen_fd = open_sse_listener(cfg.sse_bind, cfg.sse_port);
         if (sse_listen_fd < 0) {
             fprintf(stderr, "Failed to open SSE listener on %s:%d\n", cfg.sse_bind, cfg.sse_port);
-            close(sock);
+            if (uart_fd >= 0) close(uart_fd);
+            if (sock >= 0) close(sock);
             return 1;
         }
-        if (cfg.verbose) {
+        if (VERBOSE(&cfg)) {
             fprintf(stderr, "SSE: listening on %s:%d%s @ %dHz\n",
                     cfg.sse_bind, cfg.sse_port, cfg.sse_path, cfg.sse_rate_hz);
+            if (cfg.http_outputs) {
+                fprintf(stderr, "HTTP: POST /outputs on %s:%d, prio %d, ttl %dms%s, CORS origin %s\n",
+                        cfg.sse_bind, cfg.sse_port, cfg.http_prio, cfg.http_ttl_ms,
+                        cfg.http_link ? ", counts as RC link" : "",
+                        cfg.http_origin[0] ? cfg.http_origin : "none");
+            }
         }
     }
+#endif
 
-    if (cfg.verbose) {
-        fprintf(stderr,
-                "Listening UDP :%d | pwm0<-CH%d pwm1<-CH%d | %dHz | clamp %d..%dus | center %dus | hold %dms center@%dms\n",
-                cfg.port, cfg.pwm0_ch, cfg.pwm1_ch, cfg.hz, cfg.min_us, cfg.max_us, cfg.center_us,
-                cfg.hold_ms, cfg.center_timeout_ms);
+#if WAYBEAM_WITH_CTL
+    int ctl_listen_fd = -1;
+    if (cfg.ctl_path[0]) {
+        ctl_listen_fd = open_ctl_listener(cfg.ctl_path);
+        if (ctl_listen_fd < 0) {
+#if WAYBEAM_WITH_SSE
+            if (sse_listen_fd >= 0) close(sse_listen_fd);
+#endif
+            if (uart_fd >= 0) close(uart_fd);
+            if (sock >= 0) close(sock);
+            return 1;
+        }
+        if (VERBOSE(&cfg)) fprintf(stderr, "CTL: listening on %s\n", cfg.ctl_path);
+    }
+#endif
+#if WAYBEAM_WITH_INJECT
+    int inject_fd = -1;
+    inject_stats_t inj = { 0, 0, 0, 0 };
+    if (cfg.inject_path[0]) {
+        inject_fd = open_unix_socket(cfg.inject_path, SOCK_DGRAM, "inject");
+        if (inject_fd < 0) {
+#if WAYBEAM_WITH_CTL
+            if (ctl_listen_fd >= 0) {
+                close(ctl_listen_fd);
+                unlink(cfg.ctl_path);
+            }
+#endif
+#if WAYBEAM_WITH_SSE
+            if (sse_listen_fd >= 0) close(sse_listen_fd);
+#endif
+            if (uart_fd >= 0) close(uart_fd);
+            if (sock >= 0) close(sock);
+            return 1;
+        }
+        if (VERBOSE(&cfg)) fprintf(stderr, "Inject: listening on %s\n", cfg.inject_path);
+    }
+#endif
+
+    if (VERBOSE(&cfg)) {
+        fprintf(stderr, "Listening UDP :%d |", cfg.port);
+        for (int i = 0; i < cfg.out_count; i++) {
+            if (pwm[i].available) fprintf(stderr, " %d:%d<-CH%d", pwm[i].chip, pwm[i].hw, cfg.out_ch[i]);
+        }
+        fprintf(stderr, " | %dHz | clamp %d..%dus | center %dus | hold %dms center@%dms\n",
+                cfg.hz, cfg.min_us, cfg.max_us, cfg.center_us, cfg.hold_ms, cfg.center_timeout_ms);
+        if (cfg.predict) {
+            fprintf(stderr, "Predict: %s, horizon %dms, max offset %dus\n",
+                    cfg.predict == PREDICT_LINEAR ? "linear" : "alpha-beta",
+                    cfg.predict_horizon_ms, cfg.predict_max_us);
+        }
+        if (cfg.adaptive_timeouts) {
+            fprintf(stderr, "Adaptive timeouts: hold %dx / center %dx p95 interval, %d..%dms%s\n",
+                    cfg.adaptive_hold_x, cfg.adaptive_center_x, cfg.adaptive_min_ms, cfg.adaptive_max_ms,
+                    cfg.kernel_failsafe ? " (kernel heartbeat stays at --center-timeout-ms)" : "");
+        }
+        if (sock >= 0) {
+            int rcvbuf = 0;
+            socklen_t optlen = sizeof(rcvbuf);
+            getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+            if (cfg.max_age_ms) {
+                fprintf(stderr, "UDP queue: rcvbuf %d bytes, discard after %dms\n", rcvbuf, cfg.max_age_ms);
+            } else {
+                fprintf(stderr, "UDP queue: rcvbuf %d bytes\n", rcvbuf);
+            }
+        }
+        if (cfg.proto == PROTO_MAVLINK) {
+            fprintf(stderr, "Input: MAVLink v1/v2 RC_CHANNELS_OVERRIDE and RC_CHANNELS\n");
+        } else if (cfg.proto == PROTO_SBUS) {
+            fprintf(stderr, "Input: SBUS, frames with the receiver failsafe flag are ignored\n");
+        }
+        if (cfg.echo && sock >= 0) {
+            fprintf(stderr, "Echo: answering latency probes (frame type 0x%02x)\n", CRSF_TYPE_LATENCY_PROBE);
+        }
+        if (cfg.peer_lock && sock >= 0) {
+            if (cfg.peer_relearn_ms) {
+                fprintf(stderr, "Peer lock: first valid RC source, relearn after %dms silence or SIGHUP\n",
+                        cfg.peer_relearn_ms);
+            } else {
+                fprintf(stderr, "Peer lock: first valid RC source, relearn on SIGHUP\n");
+            }
+        }
+#if WAYBEAM_WITH_UART
+        if (uart_fd >= 0) {
+            fprintf(stderr, "UART: %s from %s @ %d baud %s%s\n",
+                    rc_protos[cfg.proto].label, cfg.uart_dev, cfg.uart_baud, rc_protos[cfg.proto].format,
+                    sock < 0 ? " (UDP disabled)" : "");
+        }
+#endif
+        fprintf(stderr, "Filter:");
+        for (int i = 0; i < cfg.out_count; i++) {
+            if (!pwm[i].available) continue;
+            fprintf(stderr, "%s %d:%d deadband %dus hysteresis %dus", i ? " |" : "",
+                    pwm[i].chip, pwm[i].hw, cfg.deadband_us[i], cfg.hysteresis_us[i]);
+        }
+        fprintf(stderr, "\n");
         if (cfg.no_mux) {
-            fprintf(stderr, "MUX mode: disabled (--no-mux)\n");
+            fprintf(stderr, "MUX mode: disabled (%s)\n",
+                    WAYBEAM_WITH_MUX ? "--no-mux" : "not compiled in");
         } else if (cfg.mux_init_once) {
             fprintf(stderr, "MUX mode: one-shot via %s = 0x%04x\n",
                     cfg.mux_reg, cfg.mux_init_val);
@@ -938,14 +4841,109 @@ int main(int argc, char **argv) {
         }
     }
 
-    struct pollfd pfd = { .fd = sock, .events = POLLIN, .revents = 0 };
+    // pfds: inputs, control listener and clients, then the driver
+    // failsafe_active flags (POLLPRI). Unused slots keep fd -1, which poll() skips.
+    enum {
+        PFD_UDP,
+        PFD_UART,
+#if WAYBEAM_WITH_INJECT
+        PFD_INJECT,
+#endif
+#if WAYBEAM_WITH_CTL
+        PFD_CTL,
+        PFD_CTL_CLIENT,
+        PFD_CTL_LAST = PFD_CTL_CLIENT + CTL_MAX_CLIENTS - 1,
+#endif
+#if WAYBEAM_WITH_HTTP
+        PFD_HTTP_CLIENT,
+        PFD_HTTP_LAST = PFD_HTTP_CLIENT + HTTP_MAX_CLIENTS - 1,
+#endif
+        PFD_FAILSAFE,
+    };
+    struct pollfd pfds[PFD_FAILSAFE + MAX_OUTPUTS];
+    pwm_out_t *pfd_out[PFD_FAILSAFE + MAX_OUTPUTS] = { NULL };
+    nfds_t npfds = PFD_FAILSAFE;
+    for (nfds_t k = 0; k < PFD_FAILSAFE; k++) {
+        pfds[k] = (struct pollfd){ .fd = -1, .events = POLLIN, .revents = 0 };
+    }
+    pfds[PFD_UDP].fd = sock;
+    pfds[PFD_UART].fd = uart_fd;
+#if WAYBEAM_WITH_INJECT
+    pfds[PFD_INJECT].fd = inject_fd;
+#endif
+#if WAYBEAM_WITH_CTL
+    pfds[PFD_CTL].fd = ctl_listen_fd;
+#endif
+    bool kernel_failsafe_all = true;
+    for (int i = 0; i < cfg.out_count; i++) {
+        if (!pwm[i].available) continue;
+        if (pwm[i].fd_failsafe_active < 0) {
+            kernel_failsafe_all = false;
+            continue;
+        }
+        pfd_out[npfds] = &pwm[i];
+        pfds[npfds++] = (struct pollfd){ .fd = pwm[i].fd_failsafe_active, .events = POLLPRI, .revents = 0 };
+    }
+    kernel_failsafe_all = kernel_failsafe_all && npfds > PFD_FAILSAFE;
+    // Driver owns timeouts: sleep until traffic unless something else needs ticks
+    int poll_timeout_ms = 20; // 20ms tick
+    // A locked peer hides new senders, so the silence check needs the tick too
+    bool peer_tick = cfg.peer_lock && cfg.peer_relearn_ms > 0;
+    if (kernel_failsafe_all && !cfg.sse_enabled && !peer_tick) poll_timeout_ms = -1;
+    struct pollfd *pfd_sock = &pfds[PFD_UDP];
     stream_buf_t sb = { .len = 0 };
-    uint64_t last_valid_ms = 0;
-    bool link_active = false;
-    bool centered_due_to_timeout = true; // already centered at startup
+    udp_stats_t udp = { 0, 0, 0 };
+#if WAYBEAM_WITH_ECHO
+    echo_stats_t echo = { 0, 0, 0 };
+#endif
+    struct sockaddr_in peer = { 0 };
+    bool peer_locked = false;
+    bool peer_backlog = false; // datagrams queued before connect() are not filtered
+    uint64_t peer_last_ms = 0;
+#if WAYBEAM_WITH_UART
+    struct pollfd *pfd_uart = &pfds[PFD_UART];
+    stream_buf_t uart_sb = { .len = 0 };
+    uart_stats_t uart = { 0, 0, 0, 0, 0, false };
+#endif
+#if WAYBEAM_WITH_HTTP
+    http_client_t http[HTTP_MAX_CLIENTS];
+    http_stats_t http_st = { 0, 0, 0, 0 };
+#endif
+
+    notify_ready(&cfg);
+
+    // Hot-path diagnostics go through the async ring from here on
+    if (VERBOSE(&cfg)) log_ring_start();
 
     while (!g_stop) {
-        int pr = poll(&pfd, 1, 20); // 20ms tick
+        // Checked before poll() so a SIGHUP that interrupted it is not left
+        // waiting for traffic the connected socket would now drop
+        if (peer_locked) {
+            uint64_t silence = mono_ms() - peer_last_ms;
+            bool timed_out = cfg.peer_relearn_ms > 0 && silence >= (uint64_t)cfg.peer_relearn_ms;
+            if (g_relearn || timed_out) {
+                if (udp_disconnect(sock) == 0) {
+                    peer_locked = false;
+                    peer_backlog = false;
+                    sb.len = 0;
+                    if (VERBOSE(&cfg)) {
+                        LOGE(EV_PEER_UNLOCK, (uint32_t)peer.sin_addr.s_addr, (uint32_t)ntohs(peer.sin_port),
+                             timed_out ? (uint32_t)silence : 0U);
+                    }
+                } else if (VERBOSE(&cfg)) {
+                    LOGE(EV_RECV_ERR, (uint32_t)errno);
+                }
+            }
+        }
+        g_relearn = 0;
+
+        int timeout_ms = poll_timeout_ms;
+        int predict_ms = bridge_predict_timeout_ms(&br);
+        if (predict_ms >= 0 && (timeout_ms < 0 || predict_ms < timeout_ms)) timeout_ms = predict_ms;
+        int ramp_ms = bridge_failsafe_timeout_ms(&br, mono_ms());
+        if (ramp_ms >= 0 && (timeout_ms < 0 || ramp_ms < timeout_ms)) timeout_ms = ramp_ms;
+
+        int pr = poll(pfds, npfds, timeout_ms);
         uint64_t now = mono_ms();
 
         if (pr < 0) {
@@ -954,123 +4952,338 @@ int main(int argc, char **argv) {
             break;
         }
 
-        if (pr > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
-            if (cfg.verbose) fprintf(stderr, "Socket error revents=0x%x, centering outputs\n", pfd.revents);
-            pwm_center_all(&cfg, &pwm0, &pwm1);
+        if (pr > 0 && (pfd_sock->revents & POLLERR) && udp_clear_refused(sock)) {
+            pfd_sock->revents &= ~POLLERR;
+        }
+        if (pr > 0 && (pfd_sock->revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            if (VERBOSE(&cfg)) LOGE(EV_SOCK_ERR, (uint32_t)pfd_sock->revents);
+            pwm_failsafe_all(&cfg, pwm, cfg.out_count);
             break;
         }
 
-        if (pr > 0 && (pfd.revents & POLLIN)) {
+        // Driver heartbeat fired: outputs already sit at failsafe_us
+        for (nfds_t k = PFD_FAILSAFE; pr > 0 && k < npfds; k++) {
+            if (!(pfds[k].revents & (POLLPRI | POLLERR))) continue;
+            pwm_out_t *o = pfd_out[k];
+            char flag[8] = "";
+            if (pread(o->fd_failsafe_active, flag, sizeof(flag) - 1, 0) > 0 && flag[0] == '1') {
+                if (VERBOSE(&cfg)) LOGE(EV_KFAILSAFE, (uint32_t)o->ch, (uint32_t)o->failsafe_us);
+                PROBE(failsafe_enter, "source=kernel pwm=%d age_ms=%llu", o->ch,
+                      (unsigned long long)(now - br.last_valid_ms));
+                o->last_us = o->failsafe_us;
+                br.ramp[o->ch].active = false;
+                if (kernel_failsafe_all) {
+                    br.link_active = false;
+                    br.centered = true;
+                    sb.len = 0;
+#if WAYBEAM_WITH_UART
+                    uart_sb.len = 0;
+#endif
+                }
+            }
+        }
+
+        // An empty queue after the lock only ever refills from the peer
+        if (peer_backlog && !(pfd_sock->revents & POLLIN)) peer_backlog = false;
+
+        if (pr > 0 && (pfd_sock->revents & POLLIN)) {
             uint8_t dgram[1500];
             struct sockaddr_in src;
-            socklen_t src_len = sizeof(src);
-            memset(&src, 0, sizeof(src));
-            ssize_t n = recvfrom(sock, dgram, sizeof(dgram), 0, (struct sockaddr *)&src, &src_len);
-            if (n > 0) {
+            const struct sockaddr_in *from = &peer;
+            union {
+                char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+                struct cmsghdr align;
+            } ctl;
+            struct iovec iov = { .iov_base = dgram, .iov_len = sizeof(dgram) };
+            struct msghdr msg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = ctl.buf,
+                .msg_controllen = sizeof(ctl.buf),
+            };
+            // Connected: the kernel already matched the source, skip the sockaddr,
+            // except for the backlog queued before connect()
+            if (!peer_locked || peer_backlog) {
+                memset(&src, 0, sizeof(src));
+                msg.msg_name = &src;
+                msg.msg_namelen = sizeof(src);
+                from = &src;
+            }
+            (void)from; // only read by the probes and -v logging
+            ssize_t n = recvmsg(sock, &msg, 0);
+            struct timespec rx_ts = { 0, 0 };
+            int age_ms = n > 0 ? udp_rx_cmsg(&cfg, &msg, &udp, &rx_ts) : -1;
+            if (n >= 0 && peer_locked && peer_backlog && !same_peer(&src, &peer)) {
+                udp.datagrams++;
+                if (VERBOSE(&cfg) > 1) {
+                    LOGE(EV_PEER_FOREIGN, (uint32_t)n, (uint32_t)src.sin_addr.s_addr, (uint32_t)ntohs(src.sin_port));
+                }
+            } else if (n > 0 && cfg.max_age_ms && age_ms > cfg.max_age_ms) {
+                // Backlog from a stall: replaying it would replay old motion,
+                // and a partial frame from before it must not meet fresh bytes
+                udp.datagrams++;
+                udp.stale++;
+                sb.len = 0;
+                if (VERBOSE(&cfg) > 1) LOGE(EV_UDP_STALE, (uint32_t)n, (uint32_t)age_ms);
+            } else if (n > 0) {
+                udp.datagrams++;
+                PROBE(udp_rx, "bytes=%d src=0x%08x:%u", (int)n,
+                      (unsigned)ntohl(from->sin_addr.s_addr), (unsigned)ntohs(from->sin_port));
                 crsf_stream_feed(&sb, dgram, (size_t)n);
 
                 crsf_parse_result_t res;
-                memset(&res, 0, sizeof(res));
-                crsf_stream_parse(&sb, &res, cfg.verbose);
-                if (cfg.verbose) {
-                    log_udp_rx(cfg.verbose, n, &src, &res);
+                rc_stream_parse(&cfg, &br, &sb, &res);
+#if WAYBEAM_WITH_LOG
+                if (VERBOSE(&cfg)) {
+                    log_udp_rx(VERBOSE(&cfg), n, from, &res);
                 }
+#endif
 
+#if WAYBEAM_WITH_ECHO
+                size_t writes_before = res.got_probe ? bridge_writes(&br) : 0;
+#endif
+                bridge_apply_rc(&br, &res, now);
+#if WAYBEAM_WITH_ECHO
+                if (res.got_probe && cfg.echo) {
+                    if (!rx_ts.tv_sec) clock_gettime(CLOCK_REALTIME, &rx_ts); // no kernel stamp
+                    echo_answer(sock, peer_locked ? NULL : &src, &res, &rx_ts, writes_before, &br, &echo);
+                }
+#endif
                 if (res.got_rc) {
-                    if (centered_due_to_timeout && cfg.verbose) {
-                        fprintf(stderr, "Link recovered: valid RC frame received\n");
-                    }
-                    last_valid_ms = now;
-                    link_active = true;
-                    centered_due_to_timeout = false;
-                    total_rc_frames += res.rc_frames;
-                    memcpy(last_ch_us, res.ch_us, sizeof(last_ch_us));
-
-                    if (cfg.pwm0_ch > 0 && pwm0.available) {
-                        int raw_us = res.ch_us[cfg.pwm0_ch - 1];
-                        int clamped_us = clampi(raw_us, cfg.min_us, cfg.max_us);
-                        if (cfg.verbose > 1) {
-                            fprintf(stderr, "Map: CH%d=%dus -> PWM0=%dus\n", cfg.pwm0_ch, raw_us, clamped_us);
-                        }
-                        pwm_set_us(&cfg, &pwm0, clamped_us);
-                    }
-
-                    if (cfg.pwm1_ch > 0 && pwm1.available) {
-                        int raw_us = res.ch_us[cfg.pwm1_ch - 1];
-                        int clamped_us = clampi(raw_us, cfg.min_us, cfg.max_us);
-                        if (cfg.verbose > 1) {
-                            fprintf(stderr, "Map: CH%d=%dus -> PWM1=%dus\n", cfg.pwm1_ch, raw_us, clamped_us);
+                    if (cfg.peer_lock && !peer_locked &&
+                        connect(sock, (const struct sockaddr *)&src, sizeof(src)) == 0) {
+                        peer = src;
+                        peer_locked = true;
+                        peer_backlog = true;
+                        sb.len = 0; // nothing from another sender may complete a frame
+                        if (VERBOSE(&cfg)) {
+                            LOGE(EV_PEER_LOCK, (uint32_t)peer.sin_addr.s_addr, (uint32_t)ntohs(peer.sin_port));
                         }
-                        pwm_set_us(&cfg, &pwm1, clamped_us);
-                    }
-
-                    if (cfg.verbose > 1) {
-                        fprintf(stderr, "RC: ch%02d=%d ch%02d=%d\n",
-                                cfg.pwm0_ch, (cfg.pwm0_ch ? res.ch_us[cfg.pwm0_ch - 1] : 0),
-                                cfg.pwm1_ch, (cfg.pwm1_ch ? res.ch_us[cfg.pwm1_ch - 1] : 0));
                     }
+                    peer_last_ms = now;
                 }
             } else if (n == 0) {
-                if (cfg.verbose > 1) {
-                    fprintf(stderr, "recvfrom returned 0 bytes\n");
+                if (VERBOSE(&cfg) > 1) {
+                    LOGE(EV_UDP_RX_EMPTY, 0);
                 }
+            } else if (n < 0 && errno == ECONNREFUSED) {
+                // Pending ICMP error consumed by recvmsg(), see udp_clear_refused()
             } else if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
-                if (cfg.verbose) perror("recv");
+                if (VERBOSE(&cfg)) LOGE(EV_RECV_ERR, (uint32_t)errno);
                 // On socket receive errors, stop driving stale outputs.
-                if (!centered_due_to_timeout) {
-                    pwm_center_all(&cfg, &pwm0, &pwm1);
-                    centered_due_to_timeout = true;
+                if (!br.centered) {
+                    bridge_failsafe_begin(&br, now);
+                    br.centered = true;
                 }
-                link_active = false;
+                br.link_active = false;
                 sb.len = 0;
             }
         }
 
+#if WAYBEAM_WITH_UART
+        if (pr > 0 && pfd_uart->fd >= 0 && pfd_uart->revents) {
+            uint8_t rx[256];
+            ssize_t n = (pfd_uart->revents & POLLIN) ? read(pfd_uart->fd, rx, sizeof(rx)) : 0;
+            if (n > 0) {
+                crsf_stream_feed(&uart_sb, rx, (size_t)n);
+
+                crsf_parse_result_t res;
+                rc_stream_parse(&cfg, &br, &uart_sb, &res);
+                uart.bytes += (size_t)n;
+                uart.frames += res.frames_crc_ok;
+                uart.rc += res.rc_frames;
+                uart.failsafe += res.rx_failsafe;
+                uart.lost += res.rx_lost;
+                if (!uart.frames && uart.bytes >= UART_NOSYNC_BYTES && !uart.warned) {
+                    uart_warn_nosync(pfd_uart->fd, &cfg, uart.bytes);
+                    uart.warned = true;
+                }
+                if (VERBOSE(&cfg) > 1) {
+                    LOGE(EV_UART_RX_STATS, (uint32_t)n, (uint32_t)res.frames_seen,
+                         (uint32_t)res.frames_crc_ok, (uint32_t)res.rc_frames,
+                         (uint32_t)res.frames_bad_addr, (uint32_t)res.frames_bad_crc);
+                } else if (VERBOSE(&cfg)) {
+                    LOGE(EV_UART_RX, (uint32_t)n, res.got_rc ? 1U : 0U);
+                }
+                bridge_apply_rc(&br, &res, now);
+            } else if (n == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                // Receiver unplugged or pty closed: stop polling it, the failsafe takes over
+                if (VERBOSE(&cfg)) LOGE(EV_UART_ERR, n == 0 ? 0U : (uint32_t)errno);
+                close(pfd_uart->fd);
+                pfd_uart->fd = -1;
+                uart_fd = -1;
+                uart_sb.len = 0;
+            }
+        }
+#endif
+
+#if WAYBEAM_WITH_INJECT
+        // Commit right away: injectors usually run faster than the RC link
+        if (pr > 0 && (pfds[PFD_INJECT].revents & POLLIN) && inject_service(inject_fd, &br, &inj, now)) {
+            bridge_remap(&br, now, false);
+        }
+#endif
+
+#if WAYBEAM_WITH_CTL
+        if (pr > 0 && (pfds[PFD_CTL].revents & POLLIN)) {
+            ctl_accept(ctl_listen_fd, &pfds[PFD_CTL_CLIENT], &cfg);
+        }
+        for (int k = PFD_CTL_CLIENT; pr > 0 && k <= PFD_CTL_LAST; k++) {
+            if (pfds[k].fd < 0 || !pfds[k].revents) continue;
+            if (!(pfds[k].revents & POLLIN) || ctl_service(pfds[k].fd, &cfg, &br, &udp, now) < 0) {
+                if (VERBOSE(&cfg)) LOGE(EV_CTL_CLOSED, (uint32_t)(k - PFD_CTL_CLIENT));
+                close(pfds[k].fd);
+                pfds[k].fd = -1;
+            }
+        }
+#endif
+
+#if WAYBEAM_WITH_HTTP
+        for (int k = PFD_HTTP_CLIENT; pr > 0 && k <= PFD_HTTP_LAST; k++) {
+            if (pfds[k].fd < 0 || !pfds[k].revents) continue;
+            bool changed = false;
+            if (!(pfds[k].revents & POLLIN) ||
+                http_service(pfds[k].fd, &http[k - PFD_HTTP_CLIENT], &br, &http_st, now, &changed) < 0) {
+                if (VERBOSE(&cfg)) LOGE(EV_HTTP_CLOSED, (uint32_t)(k - PFD_HTTP_CLIENT));
+                close(pfds[k].fd);
+                pfds[k].fd = -1;
+            }
+            // Commit right away, as with --inject
+            if (changed) http_commit(&br, now);
+        }
+#endif
+
+#if WAYBEAM_WITH_SSE
         // SSE: accept connections, complete handshakes, emit channel data
         if (sse_listen_fd >= 0) {
             sse_accept_pending(sse_listen_fd, &sse_pending, now);
-            sse_service_pending(&sse_pending, &sse_client_fd, cfg.sse_path, now);
+#if WAYBEAM_WITH_HTTP
+            if (sse_service_pending(&sse_pending, &sse_client_fd, cfg.sse_path, cfg.http_outputs, now) == 2) {
+                bool changed = false;
+                http_adopt(&sse_pending, &pfds[PFD_HTTP_CLIENT], http, &br, &http_st, now, &changed);
+                if (changed) http_commit(&br, now);
+            }
+#else
+            sse_service_pending(&sse_pending, &sse_client_fd, cfg.sse_path, false, now);
+#endif
 
             if (sse_client_fd >= 0 && now >= next_sse_emit_ms) {
-                int rc = sse_send_channels(sse_client_fd, last_ch_us,
-                                           link_active, centered_due_to_timeout,
-                                           total_rc_frames);
+                int rc = sse_send_channels(sse_client_fd, br.last_ch_us,
+                                           br.link_active, br.centered,
+                                           br.total_rc_frames, &udp, &br.lq, pwm, cfg.out_count);
                 if (rc < 0) {
-                    if (cfg.verbose) fprintf(stderr, "SSE: client disconnected\n");
+                    if (VERBOSE(&cfg)) LOGE(EV_SSE_DISCONNECTED, 0);
                     close(sse_client_fd);
                     sse_client_fd = -1;
                 } else {
+                    PROBE(sse_emit, "rc_frames=%llu link=%d", (unsigned long long)br.total_rc_frames,
+                          br.link_active ? 1 : 0);
                     next_sse_emit_ms = now + (uint64_t)(1000 / cfg.sse_rate_hz);
                 }
             }
         }
+#endif
+
+        if (cfg.predict && br.link_active && !br.centered) bridge_predict_tick(&br, mono_us());
+        if (br.centered) bridge_failsafe_tick(&br, now);
 
         // Failsafe logic:
-        // 0..hold_ms after last frame: hold last command
+        // 0..hold_ms after last frame: hold last command (or predict, see --predict)
         // >= center_timeout_ms: center outputs
-        if (link_active) {
-            uint64_t age = now - last_valid_ms;
-            if ((int)age >= cfg.center_timeout_ms) {
-                if (!centered_due_to_timeout) {
-                    if (cfg.verbose) {
-                        fprintf(stderr, "FAILSAFE: no valid CRSF for %llums -> center outputs\n",
-                                (unsigned long long)age);
+        // Both come from the link estimator with --adaptive-timeouts.
+        // With --kernel-failsafe on every output, the driver heartbeat does this.
+        if (br.link_active && !kernel_failsafe_all) {
+            uint64_t age = now - br.last_valid_ms;
+            if ((int)age >= br.lq.center_ms) {
+                if (!br.centered) {
+                    if (VERBOSE(&cfg)) {
+                        LOGE(EV_FAILSAFE, (uint32_t)age);
                     }
-                    pwm_center_all(&cfg, &pwm0, &pwm1);
-                    centered_due_to_timeout = true;
+                    PROBE(failsafe_enter, "source=timeout pwm=%d age_ms=%llu", -1,
+                          (unsigned long long)age);
+                    bridge_failsafe_begin(&br, now);
+                    br.centered = true;
                 }
-            } else if ((int)age >= cfg.hold_ms) {
+            } else if ((int)age >= br.lq.hold_ms) {
                 // Stage-1-like hold period has elapsed; still waiting to center at center_timeout_ms
                 // We intentionally do nothing here (holding last values).
             }
         }
     }
 
-    if (cfg.verbose) fprintf(stderr, "Stopping, centering outputs...\n");
-    pwm_center_all(&cfg, &pwm0, &pwm1);
+    log_ring_stop();
+    if (VERBOSE(&cfg)) fprintf(stderr, "Stopping, outputs to failsafe values...\n");
+    for (int i = 0; i < cfg.out_count; i++) pwm_disarm_heartbeat(&pwm[i]);
+    pwm_failsafe_all(&cfg, pwm, cfg.out_count);
+    if (VERBOSE(&cfg)) {
+        for (int i = 0; i < cfg.out_count; i++) pwm_log_stats(&pwm[i]);
+        if (br.lq.p50_us) {
+            fprintf(stderr, "Link stats: interval=%uus jitter=%uus p50=%uus p95=%uus loss=%u.%u%% hold=%dms center=%dms\n",
+                    (unsigned)(br.lq.interval_x16 / 16), (unsigned)(br.lq.jitter_x16 / 16),
+                    (unsigned)br.lq.p50_us, (unsigned)br.lq.p95_us,
+                    (unsigned)(br.lq.loss_permille / 10), (unsigned)(br.lq.loss_permille % 10),
+                    br.lq.hold_ms, br.lq.center_ms);
+        }
+        if (sock >= 0) {
+            fprintf(stderr, "UDP stats: datagrams=%zu kernel_drops=%u stale=%zu\n",
+                    udp.datagrams, (unsigned)udp.kernel_drops, udp.stale);
+        }
+#if WAYBEAM_WITH_ECHO
+        if (cfg.echo) {
+            fprintf(stderr, "Echo stats: probes=%zu replies=%zu send_errors=%zu\n",
+                    echo.probes, echo.replies, echo.send_errors);
+        }
+#endif
+#if WAYBEAM_WITH_INJECT
+        if (inject_fd >= 0) {
+            fprintf(stderr, "Inject stats: datagrams=%zu applied=%zu refused=%zu invalid=%zu\n",
+                    inj.datagrams, inj.applied, inj.refused, inj.invalid);
+        }
+#endif
+#if WAYBEAM_WITH_UART
+        if (cfg.uart_dev[0]) {
+            fprintf(stderr, "UART stats: bytes=%zu frames=%zu rc=%zu failsafe=%zu lost=%zu\n",
+                    uart.bytes, uart.frames, uart.rc, uart.failsafe, uart.lost);
+        }
+#endif
+#if WAYBEAM_WITH_HTTP
+        if (cfg.http_outputs) {
+            fprintf(stderr, "HTTP stats: requests=%zu applied=%zu refused=%zu invalid=%zu\n",
+                    http_st.requests, http_st.applied, http_st.refused, http_st.invalid);
+        }
+#endif
+    }
+#if WAYBEAM_WITH_SSE
     if (sse_client_fd >= 0) close(sse_client_fd);
     if (sse_pending.fd >= 0) close(sse_pending.fd);
     if (sse_listen_fd >= 0) close(sse_listen_fd);
-    close(sock);
+#endif
+#if WAYBEAM_WITH_HTTP
+    for (int k = PFD_HTTP_CLIENT; k <= PFD_HTTP_LAST; k++) {
+        if (pfds[k].fd >= 0) close(pfds[k].fd);
+    }
+#endif
+#if WAYBEAM_WITH_CTL
+    for (int k = PFD_CTL_CLIENT; k <= PFD_CTL_LAST; k++) {
+        if (pfds[k].fd >= 0) close(pfds[k].fd);
+    }
+    if (ctl_listen_fd >= 0) {
+        close(ctl_listen_fd);
+        unlink(cfg.ctl_path);
+    }
+#endif
+#if WAYBEAM_WITH_INJECT
+    if (inject_fd >= 0) {
+        close(inject_fd);
+        unlink(cfg.inject_path);
+    }
+#endif
+#if WAYBEAM_WITH_TRACE
+    if (g_trace_fd >= 0) close(g_trace_fd);
+#endif
+    if (uart_fd >= 0) close(uart_fd);
+    if (sock >= 0) close(sock);
+    // Last: the pidfile going away tells the init script the outputs are centered
+    if (cfg.pidfile[0]) unlink(cfg.pidfile);
     return 0;
 }
@@ -11,13 +11,41 @@ ifeq ($(BR2_PACKAGE_INFINITY6E_PWM),y)
 LINUX_PATCHES += $(INFINITY6E_PWM_PATCH_DIR)
 endif
 
+# waybeam-pwm compile-time feature selection
+INFINITY6E_PWM_CPPFLAGS = \
+	-DWAYBEAM_WITH_SSE=$(if $(BR2_PACKAGE_INFINITY6E_PWM_SSE),1,0) \
+	-DWAYBEAM_WITH_LOG=$(if $(BR2_PACKAGE_INFINITY6E_PWM_LOG),1,0) \
+	-DWAYBEAM_WITH_MUX=$(if $(BR2_PACKAGE_INFINITY6E_PWM_MUX),1,0) \
+	-DWAYBEAM_WITH_UART=$(if $(BR2_PACKAGE_INFINITY6E_PWM_UART),1,0) \
+	-DWAYBEAM_WITH_BPF=$(if $(BR2_PACKAGE_INFINITY6E_PWM_BPF),1,0) \
+	-DWAYBEAM_WITH_TRACE=$(if $(BR2_PACKAGE_INFINITY6E_PWM_TRACE),1,0) \
+	-DWAYBEAM_WITH_CTL=$(if $(BR2_PACKAGE_INFINITY6E_PWM_CTL),1,0) \
+	-DWAYBEAM_WITH_INJECT=$(if $(BR2_PACKAGE_INFINITY6E_PWM_INJECT),1,0) \
+	-DWAYBEAM_WITH_PATTERN=$(if $(BR2_PACKAGE_INFINITY6E_PWM_PATTERN),1,0) \
+	-DWAYBEAM_WITH_PWMCTL=$(if $(BR2_PACKAGE_INFINITY6E_PWM_PWMCTL),1,0) \
+	-DWAYBEAM_WITH_ECHO=$(if $(BR2_PACKAGE_INFINITY6E_PWM_ECHO),1,0) \
+	-DWAYBEAM_WITH_MAVLINK=$(if $(BR2_PACKAGE_INFINITY6E_PWM_MAVLINK),1,0) \
+	-DWAYBEAM_WITH_SBUS=$(if $(BR2_PACKAGE_INFINITY6E_PWM_SBUS),1,0) \
+	-DWAYBEAM_WITH_HTTP=$(if $(BR2_PACKAGE_INFINITY6E_PWM_HTTP),1,0) \
+	-DWAYBEAM_WITH_USDT=$(if $(BR2_PACKAGE_INFINITY6E_PWM_USDT),1,0)
+
+ifeq ($(BR2_PACKAGE_INFINITY6E_PWM_LOG),y)
+INFINITY6E_PWM_LDLIBS += -pthread
+endif
+
+ifeq ($(BR2_PACKAGE_INFINITY6E_PWM_PATTERN),y)
+INFINITY6E_PWM_LDLIBS += -lm
+endif
+
 define INFINITY6E_PWM_BUILD_CMDS
-	$(TARGET_CC) $(TARGET_CFLAGS) $(TARGET_LDFLAGS) -o $(@D)/waybeam-pwm \
-		$(BR2_EXTERNAL_GENERAL_PATH)/package/infinity6e-pwm/files/waybeam-pwm.c
+	$(TARGET_CC) $(TARGET_CFLAGS) $(INFINITY6E_PWM_CPPFLAGS) $(TARGET_LDFLAGS) -o $(@D)/waybeam-pwm \
+		$(BR2_EXTERNAL_GENERAL_PATH)/package/infinity6e-pwm/files/waybeam-pwm.c \
+		$(INFINITY6E_PWM_LDLIBS)
 endef
 
 define INFINITY6E_PWM_INSTALL_TARGET_CMDS
 	$(INSTALL) -D -m 0755 $(@D)/waybeam-pwm $(TARGET_DIR)/usr/bin/waybeam-pwm
+	$(if $(BR2_PACKAGE_INFINITY6E_PWM_PWMCTL),ln -sf waybeam-pwm $(TARGET_DIR)/usr/bin/pwmctl)
 endef
 
 $(eval $(generic-package))